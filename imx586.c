@@ -10,24 +10,59 @@
  * Copyright (C) 2024 OCTOPUS CINEMA
  */
 #include <asm/unaligned.h>
+#include <linux/build_bug.h>
 #include <linux/clk.h>
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/firmware.h>
 #include <linux/gpio/consumer.h>
 #include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/of_device.h>
 #include <linux/pm_runtime.h>
+#include <linux/property.h>
+#include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
+#include <linux/sched.h>
+#include <linux/seqlock.h>
+#include <linux/version.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
 #include <media/v4l2-fwnode.h>
 #include <media/v4l2-mediabus.h>
+#include <media/v4l2-rect.h>
+#include <media/mipi-csi2.h>
+
+#include "imx586.h"
+
+#define CREATE_TRACE_POINTS
+#include "imx586_trace.h"
 
 
 static bool monochrome_mode;
 module_param(monochrome_mode, bool, 0644);
-MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
+MODULE_PARM_DESC(monochrome_mode, "Default for sensors without mono-mode in DT: 1=mono, 0=color");
+
+static unsigned int burst_len = 32;
+module_param(burst_len, uint, 0644);
+MODULE_PARM_DESC(burst_len, "Max registers per auto-increment I2C write (1-64)");
+
+static bool async_ctrls;
+module_param(async_ctrls, bool, 0444);
+MODULE_PARM_DESC(async_ctrls, "Apply controls from a worker thread while streaming");
+
+static int autosuspend_delay_ms = 1000;
+module_param(autosuspend_delay_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_delay_ms, "Runtime PM autosuspend delay after streaming stops");
+
+static bool warm_standby;
+module_param(warm_standby, bool, 0644);
+MODULE_PARM_DESC(warm_standby, "Runtime suspend only gates xclk and keeps the sensor programmed");
 
 
 // Support for rpi kernel pre git commit 314a685
@@ -35,7 +70,11 @@ MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
 #define MEDIA_BUS_FMT_SENSOR_DATA 		0x7002
 #endif
 
-/* Chip ID */
+/*
+ * Chip ID. The sensor has no documented ID register: 0x30DC is BLKLEVEL,
+ * whose power-on value identifies the sensor only until it is written, so
+ * it is checked right after the first XCLR release.
+ */
 #define IMX586_REG_CHIP_ID				0x30DC
 #define IMX586_CHIP_ID					0x32
 
@@ -46,6 +85,25 @@ MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
 #define IMX586_STREAM_DELAY_US			25000
 #define IMX586_STREAM_DELAY_RANGE_US	1000
 
+/* Register hold */
+#define IMX586_REG_REGHOLD				0x3001
+
+/* Master mode start */
+#define IMX586_REG_XMSTA				0x3002
+
+/* XVS/XHS sync pins: pulse output select and drive (0 is Hi-Z) */
+#define IMX586_REG_XXS_OUTSEL			0x30A4
+#define IMX586_REG_XXS_DRV				0x30A6
+#define IMX586_XXS_OUTSEL_XVS			0x02
+#define IMX586_XXS_OUTSEL_XHS			0x08
+#define IMX586_XXS_DRV_XVS				0x03
+#define IMX586_XXS_DRV_XHS				0x0C
+
+/* Lowest and highest register address */
+#define IMX586_REG_BASE					0x3000
+#define IMX586_REG_MAX					0x5FFF
+#define IMX586_NUM_REGS					(IMX586_REG_MAX - IMX586_REG_BASE + 1)
+
 /* In clk */
 #define IMX586_XCLK_FREQ				24000000
 
@@ -60,6 +118,24 @@ MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
 /* SHR internal */
 #define IMX586_REG_SHR					0x3050
 #define IMX586_SHR_MIN					11
+#define IMX586_SHR_MAX					0xFFFF
+
+/*
+ * DOL (digital overlap) 2-frame HDR. The long frame is exposed from SHR0
+ * and the short one from SHR1 up to RHS1, within a frame of FSC = 2 * VMAX
+ * lines. SHR1 >= 9, RHS1 = 4n + 1 with RHS1 <= FSC - 2 * height, and
+ * SHR0 >= RHS1 + 9.
+ */
+#define IMX586_REG_SHR1					0x3054
+#define IMX586_REG_RHS1					0x3060
+#define IMX586_DOL_SHR1_MIN				9
+#define IMX586_DOL_RHS1_STEP			4
+#define IMX586_DOL_SHR0_MARGIN			9
+#define IMX586_DOL_SHORT_EXPOSURE_MIN	1
+#define IMX586_DOL_SHORT_EXPOSURE_DEFAULT	32
+
+/* Integration time offset, in HMAX clock cycles */
+#define IMX586_EXPOSURE_OFFSET			209
 
 /* Exposure control */
 #define IMX586_EXPOSURE_MIN				52
@@ -71,12 +147,17 @@ MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
 #define IMX586_REG_EXP_TH_H				0x36D0
 #define IMX586_REG_EXP_TH_L				0x36D4
 #define IMX586_REG_EXP_BK				0x36E2
+#define IMX586_EXP_TH_MAX				4095
+#define IMX586_EXP_TH_H_DEFAULT			4095
+#define IMX586_EXP_TH_L_DEFAULT			512
 
 /* Gradation compression control */
 #define IMX586_REG_CCMP1_EXP			0x36E8
 #define IMX586_REG_CCMP2_EXP			0x36E4
 #define IMX586_REG_ACMP1_EXP			0x36EE
 #define IMX586_REG_ACMP2_EXP			0x36EC
+#define IMX586_CCMP_MAX					0xFFFF
+#define IMX586_ACMP_MAX					0x0F
 
 /* Black level control */
 #define IMX586_REG_BLKLEVEL				0x30DC
@@ -87,6 +168,7 @@ MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
 
 /* Analog gain control */
 #define IMX586_REG_ANALOG_GAIN			0x306C
+#define IMX586_REG_ANALOG_GAIN1			0x306E
 #define IMX586_REG_FDG_SEL0				0x3030
 #define IMX586_ANA_GAIN_MIN				0
 #define IMX586_ANA_GAIN_MAX				240 // x3980= 72db = 0.3db x 240
@@ -100,12 +182,168 @@ MODULE_PARM_DESC(monochrome_mode, "Set for monochrome sensor: 1=mono, 0=color");
 #define IMX586_FLIP_WINMODEH    		0x3020
 #define IMX586_FLIP_WINMODEV    		0x3021
 
-/* Embedded metadata stream structure */
+/* Window cropping readout */
+#define IMX586_REG_WINMODE				0x3018
+#define IMX586_WINMODE_ALL_PIXEL		0x00
+#define IMX586_WINMODE_CROP				0x04
+#define IMX586_REG_PIX_HST				0x303C
+#define IMX586_REG_PIX_HWIDTH			0x303E
+#define IMX586_REG_PIX_VST				0x3044
+#define IMX586_REG_PIX_VWIDTH			0x3046
+
+/*
+ * Embedded metadata stream structure. The pad keeps its one line format for
+ * pipelines that size a buffer from it, but the sensor sends no embedded
+ * lines, so the buffer carries no data and the frame descriptor has no
+ * entry for it. Per-frame settings are reported through the Frame State
+ * control instead.
+ */
 #define IMX586_EMBEDDED_LINE_WIDTH 		16384
 #define IMX586_NUM_EMBEDDED_LINES 		1
 
 #define IMX586_PIXEL_RATE				74250000
 
+/* CSI-2 data rate per lane and lane count */
+#define IMX586_REG_DATARATE_SEL			0x3015
+#define IMX586_REG_LANEMODE				0x3040
+#define IMX586_LANEMODE_2LANE			0x01
+#define IMX586_LANEMODE_4LANE			0x03
+
+/*
+ * Packet headers, footers and line blanking on the link cost about an
+ * eighth on top of the payload when deriving the shortest line.
+ */
+#define IMX586_LINK_OVERHEAD_NUM		9
+#define IMX586_LINK_OVERHEAD_DEN		8
+
+/* Longest run of consecutive registers sent in one auto-increment write */
+#define IMX586_MAX_BURST_LEN			64
+
+/*
+ * A NACKed write is sent again up to IMX586_I2C_RETRIES times. After
+ * IMX586_I2C_NACK_LIMIT NACKs in a row the burst length is halved, and
+ * after IMX586_I2C_CLEAN_LIMIT good writes in a row it is doubled again.
+ */
+#define IMX586_I2C_RETRIES			3
+#define IMX586_I2C_RETRY_DELAY_US		100
+#define IMX586_I2C_NACK_LIMIT			4
+#define IMX586_I2C_CLEAN_LIMIT			256
+
+/* Register writes batched into a single i2c_transfer() */
+#define IMX586_TXN_MAX_MSGS				20
+#define IMX586_TXN_BUF_SIZE				(IMX586_TXN_MAX_MSGS * 5)
+
+/*
+ * Optional register sequence firmware, replacing the built-in common and
+ * per-mode register lists. It can only override modes already in the
+ * registry: line timing, VMAX limits and crop stay built in. After a 16
+ * byte header of magic, version, section count, payload size and payload
+ * CRC32 (all little-endian), the payload holds sections of { le16 id,
+ * le16 number of registers } each followed by bursts of { le16 address,
+ * u8 length, length bytes of data }.
+ */
+#define IMX586_FW_NAME					"imx586_regs.bin"
+#define IMX586_FW_MAGIC					0x36383549 /* "I586" */
+#define IMX586_FW_VERSION				1
+#define IMX586_FW_HEADER_SIZE			16
+#define IMX586_FW_SECTION_COMMON		0x0000
+/* Mode sections are addressed by their place in the mode registry */
+#define IMX586_FW_SECTION_MODE			0x1000
+#define IMX586_FW_SECTION_DEPTH(id)		(((id) >> 8) & 0xf)
+#define IMX586_FW_SECTION_XFER(id)		(((id) >> 4) & 0xf)
+#define IMX586_FW_SECTION_INDEX(id)		((id) & 0xf)
+
+/* Driver specific controls */
+#define IMX586_CID_BASE					(V4L2_CID_USER_BASE | 0xf000)
+#define IMX586_CID_CTRL_FENCE			(IMX586_CID_BASE + 0)
+#define IMX586_CID_CTRL_DELAYS			(IMX586_CID_BASE + 1)
+#define IMX586_CID_SYNC_MODE			(IMX586_CID_BASE + 2)
+#define IMX586_CID_SYNC_STATUS			(IMX586_CID_BASE + 3)
+#define IMX586_CID_FRAME_STATE			(IMX586_CID_BASE + 4)
+#define IMX586_CID_SHORT_EXPOSURE		(IMX586_CID_BASE + 5)
+#define IMX586_CID_SHORT_GAIN			(IMX586_CID_BASE + 6)
+#define IMX586_CID_HDR_TH_HIGH			(IMX586_CID_BASE + 7)
+#define IMX586_CID_HDR_TH_LOW			(IMX586_CID_BASE + 8)
+#define IMX586_CID_GC_KNEES				(IMX586_CID_BASE + 9)
+
+/* Multi-sensor frame sync, from the sony,sync-mode DT property */
+enum imx586_sync_mode {
+	IMX586_SYNC_OFF,
+	IMX586_SYNC_LEADER,
+	IMX586_SYNC_FOLLOWER,
+};
+
+enum imx586_sync_status {
+	IMX586_SYNC_STATUS_UNKNOWN,
+	IMX586_SYNC_STATUS_NO_SIGNAL,
+	IMX586_SYNC_STATUS_UNSTABLE,
+	IMX586_SYNC_STATUS_LOCKED,
+};
+
+/*
+ * Frames from the frame a control is set in until the first frame exposed
+ * with it, for exposure, analogue gain and vblank in that order. Values
+ * inside a register hold latch at the next frame start after release.
+ * Deferred writes paced by XVS wait for the next frame start before they
+ * are sent, which costs one more frame.
+ */
+#define IMX586_CTRL_DELAY_FRAMES		2
+#define IMX586_CTRL_DELAY_XVS_FRAMES		3
+#define IMX586_NUM_CTRL_DELAYS			3
+
+/* Frame State control: sequence, exposure, analogue gain, VMAX, HMAX */
+#define IMX586_NUM_FRAME_STATE			5
+
+/*
+ * Gradation Compression Knees control. Input levels up to CCMP1 pass
+ * with compression ratio ACMP1, up to CCMP2 with ACMP2, and the rest
+ * with the fixed final ratio.
+ */
+enum imx586_gc_knee {
+	IMX586_GC_CCMP1,
+	IMX586_GC_ACMP1,
+	IMX586_GC_CCMP2,
+	IMX586_GC_ACMP2,
+	IMX586_NUM_GC_KNEES,
+};
+
+static const u32 imx586_gc_knees_default[IMX586_NUM_GC_KNEES] = {
+	[IMX586_GC_CCMP1] = 500,
+	[IMX586_GC_ACMP1] = 0x2,
+	[IMX586_GC_CCMP2] = 11500,
+	[IMX586_GC_ACMP2] = 0x6,
+};
+
+/*
+ * Sensor fields written by the control worker. Slots are applied in this
+ * order, so VMAX always lands before the SHR that depends on it.
+ */
+enum imx586_async_reg {
+	IMX586_ASYNC_VMAX,
+	IMX586_ASYNC_SHR,
+	IMX586_ASYNC_RHS1,
+	IMX586_ASYNC_SHR1,
+	IMX586_ASYNC_GAIN,
+	IMX586_ASYNC_GAIN1,
+	IMX586_ASYNC_FDG_SEL0,
+	IMX586_ASYNC_EXP_TH_H,
+	IMX586_ASYNC_EXP_TH_L,
+	/* In enum imx586_gc_knee order */
+	IMX586_ASYNC_CCMP1,
+	IMX586_ASYNC_ACMP1,
+	IMX586_ASYNC_CCMP2,
+	IMX586_ASYNC_ACMP2,
+	IMX586_ASYNC_HMAX,
+	IMX586_ASYNC_HFLIP,
+	IMX586_ASYNC_VFLIP,
+	IMX586_ASYNC_NUM,
+};
+
+/* The worker may send every slot at once, between hold on and off */
+static_assert(IMX586_TXN_MAX_MSGS >= IMX586_ASYNC_NUM + 2);
+/* Knee slots are addressed as IMX586_ASYNC_CCMP1 + enum imx586_gc_knee */
+static_assert(IMX586_ASYNC_ACMP2 - IMX586_ASYNC_CCMP1 + 1 == IMX586_NUM_GC_KNEES);
+
 enum pad_types {
 	IMAGE_PAD,
 	METADATA_PAD,
@@ -113,11 +351,6 @@ enum pad_types {
 };
 
 
-/* Gradation compression */
-enum v4l2_xfer_func_sony {
-	V4L2_XFER_FUNC_GRADATION_COMPRESSION = 10
-};
-
 /* imx586 native and active pixel array size. */
 #define IMX586_NATIVE_WIDTH			3856U
 #define IMX586_NATIVE_HEIGHT		2180U
@@ -126,6 +359,20 @@ enum v4l2_xfer_func_sony {
 #define IMX586_PIXEL_ARRAY_WIDTH	3840U
 #define IMX586_PIXEL_ARRAY_HEIGHT	2160U
 
+/* Centred 2560x1440 window, 2x2 binned down to 720p */
+#define IMX586_720P_WINDOW_WIDTH	2560U
+#define IMX586_720P_WINDOW_HEIGHT	1440U
+#define IMX586_720P_WINDOW_LEFT		(IMX586_PIXEL_ARRAY_LEFT + \
+					 (IMX586_PIXEL_ARRAY_WIDTH - IMX586_720P_WINDOW_WIDTH) / 2)
+#define IMX586_720P_WINDOW_TOP		(IMX586_PIXEL_ARRAY_TOP + \
+					 (IMX586_PIXEL_ARRAY_HEIGHT - IMX586_720P_WINDOW_HEIGHT) / 2)
+
+/* Window cropping granularity and smallest window */
+#define IMX586_WINDOW_H_STEP		16U
+#define IMX586_WINDOW_V_STEP		4U
+#define IMX586_WINDOW_MIN_WIDTH		256U
+#define IMX586_WINDOW_MIN_HEIGHT	128U
+
 struct imx586_reg {
 	u16 address;
 	u8 val;
@@ -134,6 +381,109 @@ struct imx586_reg {
 struct IMX586_reg_list {
 	unsigned int num_of_regs;
 	const struct imx586_reg *regs;
+	/* Or, from firmware, the same registers as packed bursts */
+	const u8 *bursts;
+};
+
+/*
+ * Line timing of a mode, with the derived values the control path needs
+ * computed at build time rather than with 64-bit divisions per call.
+ */
+#define IMX586_MODE_PIXEL_RATE(w, min_hmax)				\
+	((u64)(w) * IMX586_PIXEL_RATE / (min_hmax))
+
+#define IMX586_MODE_LINE_TIMING(w, min_hmax, def_hmax)			\
+	.width = (w),							\
+	.min_HMAX = (min_hmax),						\
+	.default_HMAX = (def_hmax),					\
+	.pixel_rate = IMX586_MODE_PIXEL_RATE(w, min_hmax),		\
+	.hmax_recip = ((u64)IMX586_PIXEL_RATE << 32) /			\
+		      IMX586_MODE_PIXEL_RATE(w, min_hmax),		\
+	.default_hblank = ((def_hmax) * IMX586_MODE_PIXEL_RATE(w, min_hmax) + \
+			   IMX586_PIXEL_RATE - 1) / IMX586_PIXEL_RATE - (w)
+
+/*
+ * Latency histogram for debugfs. Bucket 0 counts events under 1 us,
+ * bucket n those from 2^(n-1) us up to 2^n us, the last one everything
+ * longer.
+ */
+#define IMX586_HIST_BUCKETS				16
+
+struct imx586_hist {
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+	u32 bucket[IMX586_HIST_BUCKETS];
+};
+
+enum imx586_stat {
+	IMX586_STAT_STREAM_ON,
+	IMX586_STAT_COMMON_REGS,
+	IMX586_STAT_MODE_REGS,
+	IMX586_STAT_CTRL_SETUP,
+	IMX586_STAT_I2C_WRITE,
+	IMX586_NUM_STATS,
+};
+
+static const char * const imx586_stat_names[IMX586_NUM_STATS] = {
+	[IMX586_STAT_STREAM_ON]		= "stream_on",
+	[IMX586_STAT_COMMON_REGS]	= "common_regs",
+	[IMX586_STAT_MODE_REGS]		= "mode_regs",
+	[IMX586_STAT_CTRL_SETUP]	= "ctrl_setup",
+	[IMX586_STAT_I2C_WRITE]		= "i2c_write",
+};
+
+/* Controls whose apply latency is tracked, by the id s_ctrl sees */
+static const struct {
+	u32 id;
+	const char *name;
+} imx586_stat_ctrls[] = {
+	{ V4L2_CID_EXPOSURE, "exposure_cluster" },
+	{ V4L2_CID_HBLANK, "hblank" },
+	{ V4L2_CID_VFLIP, "flip" },
+	{ IMX586_CID_HDR_TH_HIGH, "hdr_th_high" },
+	{ IMX586_CID_HDR_TH_LOW, "hdr_th_low" },
+	{ IMX586_CID_GC_KNEES, "gc_knees" },
+};
+
+struct imx586_stats {
+	/* Taken from the control worker as well as under the mutex */
+	spinlock_t lock;
+	struct imx586_hist hist[IMX586_NUM_STATS];
+	struct imx586_hist ctrl[ARRAY_SIZE(imx586_stat_ctrls)];
+	u64 i2c_errors;
+	u64 i2c_retries;
+	u64 i2c_xfers;
+	u64 i2c_bytes;
+	/* Bus traffic of the last stream on */
+	u64 stream_on_xfers;
+	u64 stream_on_bytes;
+};
+
+/* A mode whose register list came from firmware */
+struct imx586_fw_mode {
+	const struct imx586_mode *mode;
+	struct IMX586_reg_list reg_list;
+};
+
+/*
+ * What the sensor holds, as last written by the driver. Kept apart from
+ * regmap so checking it never switches the map to cache only under a
+ * write running on another thread.
+ */
+struct imx586_shadow {
+	spinlock_t lock;
+	DECLARE_BITMAP(valid, IMX586_NUM_REGS);
+	u8 val[IMX586_NUM_REGS];
+};
+
+/* What the active format queries report */
+struct imx586_active_fmt {
+	const struct imx586_mode *mode;
+	u32 code;
+	u32 width;
+	u32 height;
+	struct v4l2_rect crop;
 };
 
 /* Mode : resolution and related config&values */
@@ -150,6 +500,9 @@ struct imx586_mode {
 	/* mode has linear output (gradation compression disabled) */
 	bool linear;
 
+	/* mode sends DOL long and short frames on virtual channels 0 and 1 */
+	bool dol;
+
 	/* minimum H-timing */
 	uint64_t min_HMAX;
 
@@ -165,6 +518,18 @@ struct imx586_mode {
 	/* minimum SHR */
 	uint64_t min_SHR;
 
+	/* V4L2 pixel rate, width * IMX586_PIXEL_RATE / min_HMAX */
+	uint64_t pixel_rate;
+
+	/* 2^32 * IMX586_PIXEL_RATE / pixel_rate, for HBLANK -> HMAX */
+	uint32_t hmax_recip;
+
+	/* HBLANK matching default_HMAX, rounded up so it maps back exactly */
+	uint32_t default_hblank;
+
+	/* Bits per pixel on the CSI-2 link */
+	uint8_t bpp;
+
 	/* Analog crop rectangle. */
 	struct v4l2_rect crop;
 
@@ -463,7 +828,10 @@ static const struct imx586_reg mode_4k_regs[] = {
     {0x4940, 0x41}, // ADTHEN Normal mode
 };
 
-/* 2x2 binned 1080p60. 12-bit (Normal) */
+/*
+ * 2x2 binned, 12-bit (Normal). Also used by the 720p mode, which reads a
+ * centred window that imx586_write_window() programs from the mode crop.
+ */
 static const struct imx586_reg mode_1080_regs[] = {
 	{0x301A, 0x00}, // WDMODE Normal mode
 	{0x301B, 0x01}, // ADDMODE binning
@@ -486,6 +854,75 @@ static const struct imx586_reg mode_1080_regs[] = {
     {0x4940, 0x41}, // ADTHEN Normal mode
 };
 
+/* All pixel, 10-bit (Normal) */
+static const struct imx586_reg mode_4k_10bit_regs[] = {
+	{0x301A, 0x00}, // WDMODE Normal mode
+	{0x301B, 0x00}, // ADDMODE non-binning
+	{0x3022, 0x00}, // ADBIT 10-bit
+	{0x3023, 0x00}, // MDBIT 10-bit
+	{0x3024, 0x00}, // COMBI_EN no HDR combining
+	{0x36EF, 0x00}, // CCMP_EN Linear
+	{0x3069, 0x00}, // Normal mode
+
+	{0x3074, 0x64}, // Normal mode
+	{0x30D5, 0x04}, // DIG_CLP_VSTART non-binning
+    {0x3930, 0x0c}, // DUR normal mode
+    {0x3931, 0x01}, // DUR normal mode
+    {0x3A4C, 0x39}, // WAIT_ST0 Normal mode
+    {0x3A4D, 0x01}, // Normal mode
+    {0x3A50, 0x48}, // WAIT_ST1 Normal mode
+    {0x3A51, 0x01}, // Normal mode
+    {0x3E10, 0x10}, // ADTHEN Normal mode
+    {0x493C, 0x23}, // ADTHEN Normal mode
+    {0x4940, 0x41}, // ADTHEN Normal mode
+};
+
+/* 2x2 binned, 10-bit (Normal). Also used by the 10-bit 720p mode */
+static const struct imx586_reg mode_1080_10bit_regs[] = {
+	{0x301A, 0x00}, // WDMODE Normal mode
+	{0x301B, 0x01}, // ADDMODE binning
+	{0x3022, 0x00}, // ADBIT 10-bit
+	{0x3023, 0x00}, // MDBIT 10-bit
+	{0x3024, 0x00}, // COMBI_EN no HDR combining
+	{0x36EF, 0x00}, // CCMP_EN Linear
+	{0x3069, 0x00}, // Normal mode
+
+	{0x3074, 0x64}, // Normal mode
+	{0x30D5, 0x02}, // DIG_CLP_VSTART binning
+    {0x3930, 0x0c}, // DUR normal mode
+    {0x3931, 0x01}, // DUR normal mode
+    {0x3A4C, 0x39}, // WAIT_ST0 Normal mode
+    {0x3A4D, 0x01}, // Normal mode
+    {0x3A50, 0x48}, // WAIT_ST1 Normal mode
+    {0x3A51, 0x01}, // Normal mode
+    {0x3E10, 0x10}, // ADTHEN Normal mode
+    {0x493C, 0x23}, // ADTHEN Normal mode
+    {0x4940, 0x41}, // ADTHEN Normal mode
+};
+
+/* All pixel 4K30. 12-bit DOL 2-frame HDR, long and short on VC0/VC1 */
+static const struct imx586_reg mode_4k_dol_regs[] = {
+	{0x301A, 0x01}, // WDMODE DOL HDR
+	{0x301B, 0x00}, // ADDMODE non-binning
+	{0x3022, 0x02}, // ADBIT 12-bit
+	{0x3023, 0x01}, // MDBIT 12-bit
+	{0x3024, 0x00}, // COMBI_EN no HDR combining
+	{0x36EF, 0x00}, // CCMP_EN Linear
+    {0x3069, 0x00}, // Normal mode
+
+	{0x3074, 0x64}, // Normal mode
+	{0x30D5, 0x04}, // DIG_CLP_VSTART non-binning
+    {0x3930, 0x0c}, // DUR normal mode 12bit
+    {0x3931, 0x01}, // DUR normal mode 12bit
+    {0x3A4C, 0x39}, // WAIT_ST0 Normal mode
+    {0x3A4D, 0x01}, // Normal mode
+    {0x3A50, 0x48}, // WAIT_ST1 Normal mode
+    {0x3A51, 0x01}, // Normal mode
+    {0x3E10, 0x10}, // ADTHEN Normal mode
+    {0x493C, 0x23}, // ADTHEN Normal mode
+    {0x4940, 0x41}, // ADTHEN Normal mode
+};
+
 /* All pixel 4K30. 12-bit (HDR gradation compression) */
 static const struct imx586_reg mode_4k_nonlinear_regs[] = {
     {0x301A, 0x10}, // WDMODE Clear HDR
@@ -586,13 +1023,12 @@ static const struct imx586_reg mode_1080_16bit_regs[] = {
 static const struct imx586_mode supported_modes_12bit[] = {
 	{
 		/* 4K60 All pixel */
-		.width = 3856,
+		IMX586_MODE_LINE_TIMING(3856, 550, 550),
+		.bpp = 12,
 		.height = 2180,
 		.hdr = false,
 		.linear = true,
-		.min_HMAX = 550,
 		.min_VMAX = 2250,
-		.default_HMAX = 550,
 		.default_VMAX = 2250,
 		.min_SHR = 20,
 		.crop = {
@@ -608,13 +1044,12 @@ static const struct imx586_mode supported_modes_12bit[] = {
 	},
 	{
 		/* 1080p90 2x2 binning */
-		.width = 1928,
+		IMX586_MODE_LINE_TIMING(1928, 366, 366),
+		.bpp = 12,
 		.height = 1090,
 		.hdr = false,
 		.linear = true,
-		.min_HMAX = 366,
 		.min_VMAX = 2250,
-		.default_HMAX = 366,
 		.default_VMAX = 2250,
 		.min_SHR = 20,
 		.crop = {
@@ -628,20 +1063,111 @@ static const struct imx586_mode supported_modes_12bit[] = {
 			.regs = mode_1080_regs,
 		},
 	},
+	{
+		/* 720p120 2x2 binning */
+		IMX586_MODE_LINE_TIMING(1280, 366, 366),
+		.bpp = 12,
+		.height = 720,
+		.hdr = false,
+		.linear = true,
+		.min_VMAX = 1500,
+		.default_VMAX = 1690,
+		.min_SHR = 20,
+		.crop = {
+			.left = IMX586_720P_WINDOW_LEFT,
+			.top = IMX586_720P_WINDOW_TOP,
+			.width = IMX586_720P_WINDOW_WIDTH,
+			.height = IMX586_720P_WINDOW_HEIGHT,
+		},
+		.reg_list = {
+			.num_of_regs = ARRAY_SIZE(mode_1080_regs),
+			.regs = mode_1080_regs,
+		},
+	},
+};
+
+/*
+ * The 10-bit modes only narrow the ADC and the output. They keep the
+ * 12-bit line timing, so the frame rates are the same and only the CSI-2
+ * bandwidth drops.
+ */
+static const struct imx586_mode supported_modes_10bit[] = {
+	{
+		/* 4K All pixel, 10-bit */
+		IMX586_MODE_LINE_TIMING(3856, 550, 550),
+		.bpp = 10,
+		.height = 2180,
+		.hdr = false,
+		.linear = true,
+		.min_VMAX = 2250,
+		.default_VMAX = 2250,
+		.min_SHR = 20,
+		.crop = {
+			.left = IMX586_PIXEL_ARRAY_LEFT,
+			.top = IMX586_PIXEL_ARRAY_TOP,
+			.width = IMX586_PIXEL_ARRAY_WIDTH,
+			.height = IMX586_PIXEL_ARRAY_HEIGHT,
+		},
+		.reg_list = {
+			.num_of_regs = ARRAY_SIZE(mode_4k_10bit_regs),
+			.regs = mode_4k_10bit_regs,
+		},
+	},
+	{
+		/* 1080p 2x2 binning, 10-bit */
+		IMX586_MODE_LINE_TIMING(1928, 366, 366),
+		.bpp = 10,
+		.height = 1090,
+		.hdr = false,
+		.linear = true,
+		.min_VMAX = 2250,
+		.default_VMAX = 2250,
+		.min_SHR = 20,
+		.crop = {
+			.left = IMX586_PIXEL_ARRAY_LEFT,
+			.top = IMX586_PIXEL_ARRAY_TOP,
+			.width = IMX586_PIXEL_ARRAY_WIDTH,
+			.height = IMX586_PIXEL_ARRAY_HEIGHT,
+		},
+		.reg_list = {
+			.num_of_regs = ARRAY_SIZE(mode_1080_10bit_regs),
+			.regs = mode_1080_10bit_regs,
+		},
+	},
+	{
+		/* 720p 2x2 binning, 10-bit */
+		IMX586_MODE_LINE_TIMING(1280, 366, 366),
+		.bpp = 10,
+		.height = 720,
+		.hdr = false,
+		.linear = true,
+		.min_VMAX = 1500,
+		.default_VMAX = 1690,
+		.min_SHR = 20,
+		.crop = {
+			.left = IMX586_720P_WINDOW_LEFT,
+			.top = IMX586_720P_WINDOW_TOP,
+			.width = IMX586_720P_WINDOW_WIDTH,
+			.height = IMX586_720P_WINDOW_HEIGHT,
+		},
+		.reg_list = {
+			.num_of_regs = ARRAY_SIZE(mode_1080_10bit_regs),
+			.regs = mode_1080_10bit_regs,
+		},
+	},
 };
 
 static const struct imx586_mode supported_modes_nonlinear_12bit[] = {
 	{
 		/* 4K30 All pixel */
-		.width = 3856,
+		IMX586_MODE_LINE_TIMING(3856, 550, 550),
+		.bpp = 12,
 		.height = 2180,
 		.hdr = true,
 		.linear = false,
 		//.min_HMAX = 760,
-		.min_HMAX = 550, // Clear HDR original
 		//.min_VMAX = 2250,
 		.min_VMAX = 4500, // Clear HDR original
-		.default_HMAX = 550,
 		.default_VMAX = 4500,
 		// .default_HMAX = 550,
 		// .default_VMAX = 4500,
@@ -659,18 +1185,42 @@ static const struct imx586_mode supported_modes_nonlinear_12bit[] = {
 	},
 };
 
+static const struct imx586_mode supported_modes_dol_12bit[] = {
+	{
+		/* 4K30 All pixel, DOL 2-frame. VMAX here is FSC = 2 * VMAX */
+		IMX586_MODE_LINE_TIMING(3856, 550, 550),
+		.bpp = 12,
+		.height = 2180,
+		.hdr = false,
+		.linear = true,
+		.dol = true,
+		.min_VMAX = 4500,
+		.default_VMAX = 4500,
+		.min_SHR = 20,
+		.crop = {
+			.left = IMX586_PIXEL_ARRAY_LEFT,
+			.top = IMX586_PIXEL_ARRAY_TOP,
+			.width = IMX586_PIXEL_ARRAY_WIDTH,
+			.height = IMX586_PIXEL_ARRAY_HEIGHT,
+		},
+		.reg_list = {
+			.num_of_regs = ARRAY_SIZE(mode_4k_dol_regs),
+			.regs = mode_4k_dol_regs,
+		},
+	},
+};
+
 static const struct imx586_mode supported_modes_16bit[] = {
 	{
 		/* 1080p30 2x2 binning */
-		.width = 1928,
+		IMX586_MODE_LINE_TIMING(1928, 550, 550),
+		.bpp = 16,
 		.height = 1090,
 		.hdr = true,
 		.linear = true,
 		//.min_HMAX = 760,
-		.min_HMAX = 550, // Clear HDR original
 		//.min_VMAX = 2250,
 		.min_VMAX = 4500, // Clear HDR original
-		.default_HMAX = 550,
 		.default_VMAX = 4500,
 		// .default_HMAX = 550,
 		// .default_VMAX = 4500,
@@ -688,15 +1238,14 @@ static const struct imx586_mode supported_modes_16bit[] = {
 	},
 	{
 		/* 4K30 All pixel */
-		.width = 3856,
+		IMX586_MODE_LINE_TIMING(3856, 550, 550),
+		.bpp = 16,
 		.height = 2180,
 		.hdr = true,
 		.linear = true,
 		//.min_HMAX = 760,
-		.min_HMAX = 550, // Clear HDR original
 		//.min_VMAX = 2250,
 		.min_VMAX = 4500, // Clear HDR original
-		.default_HMAX = 550,
 		.default_VMAX = 4500,
 		// .default_HMAX = 550,
 		// .default_VMAX = 4500,
@@ -715,13 +1264,9 @@ static const struct imx586_mode supported_modes_16bit[] = {
 };
 
 /*
- * The supported formats.
- * This table MUST contain 4 entries per format, to cover the various flip
- * combinations in the order
- * - no flip
- * - h flip
- * - v flip
- * - h&v flips
+ * The supported formats, 4 Bayer orders per depth with the RGGB order the
+ * sensor outputs first. Flips keep RGGB, so the other orders are only
+ * accepted from userspace and map to their depth's RGGB code.
  */
 static const u32 codes[] = {
 	/* 16-bit modes. */
@@ -734,6 +1279,11 @@ static const u32 codes[] = {
 	MEDIA_BUS_FMT_SGRBG12_1X12,
 	MEDIA_BUS_FMT_SGBRG12_1X12,
 	MEDIA_BUS_FMT_SBGGR12_1X12,
+	/* 10-bit modes. */
+	MEDIA_BUS_FMT_SRGGB10_1X10,
+	MEDIA_BUS_FMT_SGRBG10_1X10,
+	MEDIA_BUS_FMT_SGBRG10_1X10,
+	MEDIA_BUS_FMT_SBGGR10_1X10,
 };
 
 
@@ -742,8 +1292,25 @@ static const u32 mono_codes[] = {
     MEDIA_BUS_FMT_Y16_1X16,
     /* 12-bit modes. */
     MEDIA_BUS_FMT_Y12_1X12,
+    /* 10-bit modes. */
+    MEDIA_BUS_FMT_Y10_1X10,
+};
+
+
+/* Link frequencies, indexed by their DATARATE_SEL value */
+static const s64 imx586_link_freqs[] = {
+	1188000000,	/* 2376 Mbps per lane */
+	1039500000,	/* 2079 Mbps */
+	891000000,	/* 1782 Mbps */
+	720000000,	/* 1440 Mbps */
+	594000000,	/* 1188 Mbps */
+	445500000,	/* 891 Mbps */
+	360000000,	/* 720 Mbps */
+	297000000,	/* 594 Mbps */
 };
 
+/* Link the common register table was written for */
+#define IMX586_DEFAULT_LINK_FREQ_IDX	2
 
 /* regulator supplies */
 static const char * const imx586_supply_name[] = {
@@ -762,6 +1329,13 @@ static const char * const imx586_supply_name[] = {
 #define imx586_XCLR_MIN_DELAY_US	500000
 #define imx586_XCLR_DELAY_RANGE_US	1000
 
+/*
+ * Readiness polling after XCLR: the chip ID is read back with a growing
+ * interval until it answers or imx586_XCLR_MIN_DELAY_US have passed.
+ */
+#define IMX586_READY_POLL_MIN_US	500
+#define IMX586_READY_POLL_MAX_US	16000
+
 struct imx586_compatible_data {
 	unsigned int chip_id;
 	struct IMX586_reg_list extra_regs;
@@ -773,29 +1347,109 @@ struct imx586 {
 
 	unsigned int fmt_code;
 
+	/* CSI-2 link from the endpoint */
+	unsigned int link_freq_idx;
+	unsigned int lanes;
+
+	/*
+	 * Line timing of the current mode on this link. It is the mode's
+	 * precomputed timing unless the link is too slow for its min_HMAX.
+	 */
+	struct {
+		u32 min_HMAX;
+		u32 default_HMAX;
+		u64 pixel_rate;
+		u32 hmax_recip;
+		u32 default_hblank;
+	} line;
+
+	/*
+	 * Active analog crop. Anything smaller than the pixel array reads
+	 * out a window of an all-pixel mode, and the output size follows it.
+	 */
+	struct v4l2_rect crop;
+	u32 width;
+	u32 height;
+
+	struct regmap *regmap;
+	struct imx586_shadow *shadow;
+
 	struct clk *xclk;
 	u32 xclk_freq;
 
 	struct gpio_desc *reset_gpio;
 	struct regulator_bulk_data supplies[imx586_NUM_SUPPLIES];
 
+	/*
+	 * IMX586_POWER_WARM: runtime suspended with only xclk gated. Supplies
+	 * and XCLR stay up, so the sensor keeps its registers in standby.
+	 */
+	enum {
+		IMX586_POWER_OFF,
+		IMX586_POWER_WARM,
+		IMX586_POWER_ON,
+	} power_state;
+
+	/* Chip ID checked, on the first cold power up unless done in probe */
+	bool defer_identify;
+	bool identified;
+
+	/* Board timing from DT, defaulting to the worst case waits */
+	u32 xclr_delay_us;
+	u32 ready_timeout_us;
+	u32 stream_delay_us;
+
+	/*
+	 * Per-sensor settings from DT. Unset ones follow the module
+	 * parameter: burst_len 0 and warm_standby -1 track it at run time.
+	 */
+	unsigned int burst_len;
+	int warm_standby;
+	bool async_ctrls;
+	u32 autosuspend_delay_ms;
+	u32 hdr_th_def[2];
+
 	struct v4l2_ctrl_handler ctrl_handler;
 	/* V4L2 Controls */
 	struct v4l2_ctrl *pixel_rate;
-	struct v4l2_ctrl *exposure;
+	struct {
+		/* Exposure cluster, written in a single register hold */
+		struct v4l2_ctrl *exposure;
+		struct v4l2_ctrl *gain;
+		struct v4l2_ctrl *vblank;
+		/* DOL short frame */
+		struct v4l2_ctrl *short_exposure;
+		struct v4l2_ctrl *short_gain;
+	};
+	struct v4l2_ctrl *hdr_th_high;
+	struct v4l2_ctrl *hdr_th_low;
+	struct v4l2_ctrl *gc_knees;
 	struct v4l2_ctrl *vflip;
 	struct v4l2_ctrl *hflip;
-	struct v4l2_ctrl *vblank;
 	struct v4l2_ctrl *hblank;
+	struct v4l2_ctrl *sync_ctrl;
+	struct v4l2_ctrl *link_freq;
 
 	/* Current mode */
 	const struct imx586_mode *mode;
 
+	/*
+	 * Copy of the active format for get_fmt, get_selection and
+	 * get_frame_desc, so they never wait on the mutex behind a stream on.
+	 * Republished under the mutex whenever the mode or window changes.
+	 */
+	seqlock_t active_lock;
+	struct imx586_active_fmt active;
+
     /* Mono mode */
     bool mono;
 
 	uint16_t HMAX;
 	uint32_t VMAX;
+
+	/* Whole-line parts of IMX586_EXPOSURE_OFFSET at the current HMAX */
+	u32 exp_offset_lines;
+	u32 shr_offset_lines;
 	/*
 	 * Mutex for serialized access:
 	 * Protect sensor module set pad format and start/stop streaming safely.
@@ -808,426 +1462,1476 @@ struct imx586 {
 	/* Rewrite common registers on stream on? */
 	bool common_regs_written;
 
-	/* Any extra information related to different compatible sensors */
-	const struct imx586_compatible_data *compatible_data;
-};
+	struct imx586_stats stats;
+	struct dentry *debugfs;
 
-static inline struct imx586 *to_imx586(struct v4l2_subdev *_sd)
-{
-	return container_of(_sd, struct imx586, sd);
-}
+	/* Sensor bus clock, from the I2C controller node */
+	u32 i2c_hz;
+	/* Burst length left after NACK fallbacks, NACKs and good writes in a row */
+	unsigned int burst_limit;
+	unsigned int i2c_nacks;
+	unsigned int i2c_clean;
 
-static inline void get_mode_table(struct imx586 *imx586, unsigned int code, enum v4l2_xfer_func transfer_function,
-				  const struct imx586_mode **mode_list,
-				  unsigned int *num_modes)
-{
+	/* Register sequences loaded from IMX586_FW_NAME, if any */
+	struct completion fw_done;
+	struct IMX586_reg_list fw_common;
+	struct imx586_fw_mode *fw_modes;
+	unsigned int fw_num_modes;
 
-    struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-    
+	/*
+	 * Deferred control writes. Slots hold the newest value per register
+	 * and async_pending flags the slots the worker still has to send. A
+	 * control batch publishes all its slots there at once, so the worker
+	 * never sends part of a cluster. async_active is only changed under
+	 * the mutex.
+	 */
+	struct kthread_worker *ctrl_worker;
+	struct kthread_work ctrl_work;
+	u32 async_val[IMX586_ASYNC_NUM];
+	atomic_long_t async_pending;
+	bool async_active;
 
-    if(imx586->mono){
-        switch (code) {
-        case MEDIA_BUS_FMT_Y16_1X16:
-            *mode_list = supported_modes_16bit;
-            *num_modes = ARRAY_SIZE(supported_modes_16bit);
-            break;
-        case MEDIA_BUS_FMT_Y12_1X12:
-            if ( transfer_function == (enum v4l2_xfer_func)V4L2_XFER_FUNC_GRADATION_COMPRESSION ) {
-                *mode_list = supported_modes_nonlinear_12bit;
-                *num_modes = ARRAY_SIZE(supported_modes_nonlinear_12bit);
-            } else {
-                *mode_list = supported_modes_12bit;
-                *num_modes = ARRAY_SIZE(supported_modes_12bit);
-            }
-            break;
-        default:
-            *mode_list = NULL;
-            *num_modes = 0;
-        }
-    }
-    else{
-        switch (code) {
-        /* 16-bit */
-        case MEDIA_BUS_FMT_SRGGB16_1X16:
-        case MEDIA_BUS_FMT_SGRBG16_1X16:
-        case MEDIA_BUS_FMT_SGBRG16_1X16:
-        case MEDIA_BUS_FMT_SBGGR16_1X16:
-            *mode_list = supported_modes_16bit;
-            *num_modes = ARRAY_SIZE(supported_modes_16bit);
-            break;
-        /* 12-bit */
-        case MEDIA_BUS_FMT_SRGGB12_1X12:
-        case MEDIA_BUS_FMT_SGRBG12_1X12:
-        case MEDIA_BUS_FMT_SGBRG12_1X12:
-        case MEDIA_BUS_FMT_SBGGR12_1X12:
-            if ( transfer_function == (enum v4l2_xfer_func)V4L2_XFER_FUNC_GRADATION_COMPRESSION ) {
-                *mode_list = supported_modes_nonlinear_12bit;
-                *num_modes = ARRAY_SIZE(supported_modes_nonlinear_12bit);
-            } else {
-                *mode_list = supported_modes_12bit;
-                *num_modes = ARRAY_SIZE(supported_modes_12bit);
-            }
-            break;
-        default:
-            *mode_list = NULL;
-            *num_modes = 0;
-        }
-    }
-}
+	/*
+	 * Optional XVS (frame start) interrupt. When wired, deferred writes
+	 * are sent at frame start instead of as soon as they are queued.
+	 */
+	int xvs_irq;
+	atomic_t frame_seq;
 
-/* Read registers up to 2 at a time */
-static int imx586_read_reg(struct imx586 *imx586, u16 reg, u32 len, u32 *val)
+	/* Sync mode latched at stream on, and XVS timing to judge the lock */
+	enum imx586_sync_mode sync_mode;
+	u64 xvs_last_ns;
+	u64 xvs_interval_ns;
+	u64 xvs_prev_interval_ns;
+
+	/*
+	 * Register values last sent to the sensor, and those it latched at
+	 * the start of frame live_seq. Both are protected by state_lock, as
+	 * the XVS interrupt moves one into the other.
+	 */
+	spinlock_t state_lock;
+	u32 state_sent[IMX586_ASYNC_NUM];
+	u32 state_live[IMX586_ASYNC_NUM];
+	u32 live_seq;
+
+	/* Any extra information related to different compatible sensors */
+	const struct imx586_compatible_data *compatible_data;
+};
+
+/*
+ * A batch of register writes sent as one multi-message i2c_transfer(), so
+ * related updates cost a single bus arbitration and cannot be split by
+ * another master between messages.
+ */
+struct imx586_txn {
+	struct imx586 *imx586;
+	struct i2c_client *client;
+	struct i2c_msg msgs[IMX586_TXN_MAX_MSGS];
+	u8 buf[IMX586_TXN_BUF_SIZE];
+	unsigned int num_msgs;
+	/* Queued messages other than register hold toggles */
+	unsigned int num_writes;
+	unsigned int used;
+	int error;
+	/* Deferred slots, published by imx586_ctrl_commit() */
+	unsigned long async_pending;
+};
+
+static inline struct imx586 *to_imx586(struct v4l2_subdev *_sd)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-	struct i2c_msg msgs[2];
-	u8 addr_buf[2] = { reg >> 8, reg & 0xff };
-	u8 data_buf[4] = { 0, };
-	int ret;
+	return container_of(_sd, struct imx586, sd);
+}
 
-	if (len > 4)
-		return -EINVAL;
+/*
+ * Mode registry, indexed by bit depth and transfer function. Depths are in
+ * codes[] / mono_codes[] order, and 10 and 16-bit offer the same modes
+ * whatever the transfer function.
+ */
+enum imx586_depth {
+	IMX586_DEPTH_16,
+	IMX586_DEPTH_12,
+	IMX586_DEPTH_10,
+	IMX586_NUM_DEPTHS,
+};
+
+enum imx586_xfer_class {
+	IMX586_XFER_LINEAR,
+	IMX586_XFER_GC,
+	IMX586_XFER_DOL,
+	IMX586_NUM_XFER_CLASSES,
+};
+
+struct imx586_mode_table {
+	const struct imx586_mode *modes;
+	unsigned int num_modes;
+};
+
+#define IMX586_MODE_TABLE(m)	{ .modes = (m), .num_modes = ARRAY_SIZE(m) }
+#define IMX586_MODE_TABLE_ANY_XFER(m) {				\
+		[IMX586_XFER_LINEAR] = IMX586_MODE_TABLE(m),		\
+		[IMX586_XFER_GC] = IMX586_MODE_TABLE(m),		\
+		[IMX586_XFER_DOL] = IMX586_MODE_TABLE(m),		\
+	}
 
-	/* Write register address */
-	msgs[0].addr = client->addr;
-	msgs[0].flags = 0;
-	msgs[0].len = ARRAY_SIZE(addr_buf);
-	msgs[0].buf = addr_buf;
+static const struct imx586_mode_table
+imx586_mode_registry[IMX586_NUM_DEPTHS][IMX586_NUM_XFER_CLASSES] = {
+	[IMX586_DEPTH_16] = IMX586_MODE_TABLE_ANY_XFER(supported_modes_16bit),
+	[IMX586_DEPTH_12] = {
+		[IMX586_XFER_LINEAR] = IMX586_MODE_TABLE(supported_modes_12bit),
+		[IMX586_XFER_GC] = IMX586_MODE_TABLE(supported_modes_nonlinear_12bit),
+		[IMX586_XFER_DOL] = IMX586_MODE_TABLE(supported_modes_dol_12bit),
+	},
+	[IMX586_DEPTH_10] = IMX586_MODE_TABLE_ANY_XFER(supported_modes_10bit),
+};
 
-	/* Read data from register */
-	msgs[1].addr = client->addr;
-	msgs[1].flags = I2C_M_RD;
-	msgs[1].len = len;
-	msgs[1].buf = &data_buf[4 - len];
+/* imx586_code_depth() relies on 4 Bayer orders per depth */
+static_assert(ARRAY_SIZE(codes) == 4 * IMX586_NUM_DEPTHS);
+static_assert(ARRAY_SIZE(mono_codes) == IMX586_NUM_DEPTHS);
 
-	ret = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
-	if (ret != ARRAY_SIZE(msgs))
-		return -EIO;
+/* Bit depth of a code valid for this sensor variant, or -EINVAL */
+static int imx586_code_depth(struct imx586 *imx586, u32 code)
+{
+	const u32 *list = imx586->mono ? mono_codes : codes;
+	unsigned int num = imx586->mono ? ARRAY_SIZE(mono_codes) : ARRAY_SIZE(codes);
+	unsigned int per_depth = num / IMX586_NUM_DEPTHS;
+	unsigned int i;
 
-	*val = get_unaligned_be32(data_buf);
+	for (i = 0; i < num; i++)
+		if (list[i] == code)
+			return i / per_depth;
 
-	return 0;
+	return -EINVAL;
 }
 
-/* Write registers 1 byte at a time */
-static int imx586_write_reg_1byte(struct imx586 *imx586, u16 reg, u8 val)
+static enum imx586_xfer_class imx586_xfer_class(enum v4l2_xfer_func xfer)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-	u8 buf[3];
-	int ret;
+	switch ((int)xfer) {
+	case V4L2_XFER_FUNC_GRADATION_COMPRESSION:
+		return IMX586_XFER_GC;
+	case V4L2_XFER_FUNC_DOL_HDR:
+		return IMX586_XFER_DOL;
+	default:
+		return IMX586_XFER_LINEAR;
+	}
+}
 
-	put_unaligned_be16(reg, buf);
-	buf[2] = val;
-	ret = i2c_master_send(client, buf, 3);
-	if ( ret != 3 )
-		return ret;
+static inline void get_mode_table(struct imx586 *imx586, unsigned int code, enum v4l2_xfer_func transfer_function,
+				  const struct imx586_mode **mode_list,
+				  unsigned int *num_modes)
+{
+	const struct imx586_mode_table *table;
+	int depth = imx586_code_depth(imx586, code);
 
-	return 0;
+	if (depth < 0) {
+		*mode_list = NULL;
+		*num_modes = 0;
+		return;
+	}
+
+	table = &imx586_mode_registry[depth][imx586_xfer_class(transfer_function)];
+	*mode_list = table->modes;
+	*num_modes = table->num_modes;
 }
 
-/* Write registers 2 byte at a time */
-static int imx586_write_reg_2byte(struct imx586 *imx586, u16 reg, u16 val)
+/* Registers that must always reach the sensor and are never shadowed */
+static const struct regmap_range imx586_volatile_ranges[] = {
+	/* MODE_SELECT, REGHOLD and XMSTA */
+	regmap_reg_range(IMX586_REG_MODE_SELECT, IMX586_REG_XMSTA),
+	regmap_reg_range(IMX586_REG_CHIP_ID, IMX586_REG_CHIP_ID),
+};
+
+/* Written values are tracked in struct imx586_shadow, not by regmap */
+static const struct regmap_config imx586_regmap_config = {
+	.reg_bits = 16,
+	.val_bits = 8,
+	.max_register = IMX586_REG_MAX,
+	.cache_type = REGCACHE_NONE,
+};
+
+/* Read a 1 to 4 byte little-endian register field */
+static int imx586_read_reg(struct imx586 *imx586, u16 reg, u32 len, u32 *val)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
 	u8 buf[4];
+	unsigned int i;
 	int ret;
 
-	put_unaligned_be16(reg, buf);
-	buf[2] = val;
-	buf[3] = val>>8;
-	ret = i2c_master_send(client, buf, 4);
-	if ( ret != 4 )
+	if (len > 4)
+		return -EINVAL;
+
+	ret = regmap_bulk_read(imx586->regmap, reg, buf, len);
+	if (ret)
 		return ret;
 
+	*val = 0;
+	for (i = 0; i < len; i++)
+		*val |= (u32)buf[i] << (8 * i);
+
 	return 0;
 }
 
-/* Write registers 3 byte at a time */
-static int imx586_write_reg_3byte(struct imx586 *imx586, u16 reg, u32 val)
+/*
+ * Does the sensor already hold @val in @reg? Only the shadow is
+ * consulted; volatile and never-written registers always report false.
+ */
+static bool imx586_reg_programmed(struct imx586 *imx586, u16 reg, u8 val)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-	u8 buf[5];
+	struct imx586_shadow *sh = imx586->shadow;
+	unsigned int i = reg - IMX586_REG_BASE;
+	bool ret;
 
-	put_unaligned_be16(reg, buf);
-	buf[2]  = val;
-	buf[3]  = val>>8;
-	buf[4]  = val>>16;
-	if (i2c_master_send(client, buf, 5) != 5)
-		return -EIO;
+	if (reg < IMX586_REG_BASE || reg > IMX586_REG_MAX)
+		return false;
 
-	return 0;
+	spin_lock(&sh->lock);
+	ret = test_bit(i, sh->valid) && sh->val[i] == val;
+	spin_unlock(&sh->lock);
+
+	return ret;
 }
 
-/* Write a list of 1 byte registers */
-static int imx586_write_regs(struct imx586 *imx586,
-			     const struct imx586_reg *regs, u32 len)
+/* Note @len registers from @reg on as written with @buf */
+static void imx586_reg_record(struct imx586 *imx586, u16 reg, const u8 *buf,
+			      unsigned int len)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct imx586_shadow *sh = imx586->shadow;
 	unsigned int i;
-	int ret;
 
+	spin_lock(&sh->lock);
 	for (i = 0; i < len; i++) {
-		ret = imx586_write_reg_1byte(imx586, regs[i].address, regs[i].val);
-		if (ret) {
-			dev_err_ratelimited(&client->dev,
-						"Failed to write reg 0x%4.4x. error = %d\n",
-						regs[i].address, ret);
-
-			return ret;
-		}
+		if (reg + i < IMX586_REG_BASE || reg + i > IMX586_REG_MAX ||
+		    regmap_reg_in_ranges(reg + i, imx586_volatile_ranges,
+					 ARRAY_SIZE(imx586_volatile_ranges)))
+			continue;
+		sh->val[reg + i - IMX586_REG_BASE] = buf[i];
+		__set_bit(reg + i - IMX586_REG_BASE, sh->valid);
 	}
-
-	return 0;
+	spin_unlock(&sh->lock);
 }
 
-/* Hold register values until hold is disabled */
-static inline void imx586_register_hold(struct imx586 *imx586, bool hold)
+/* Forget a register range whose contents are unknown after a failed write */
+static void imx586_reg_invalidate(struct imx586 *imx586, u16 reg,
+				  unsigned int len)
 {
-	imx586_write_reg_1byte(imx586, 0x3001, hold ? 1 : 0);
+	struct imx586_shadow *sh = imx586->shadow;
+	unsigned int start = max_t(unsigned int, reg, IMX586_REG_BASE);
+	unsigned int end = min_t(unsigned int, reg + len, IMX586_REG_MAX + 1);
+
+	if (start >= end)
+		return;
+
+	spin_lock(&sh->lock);
+	bitmap_clear(sh->valid, start - IMX586_REG_BASE, end - start);
+	spin_unlock(&sh->lock);
 }
 
-/* Get bayer order based on flip setting. */
-static u32 imx586_get_format_code(struct imx586 *imx586, u32 code)
+static void imx586_hist_add(struct imx586_hist *h, u64 ns)
 {
-	unsigned int i;
-	lockdep_assert_held(&imx586->mutex);
+	unsigned int b = min_t(unsigned int, fls64(div_u64(ns, NSEC_PER_USEC)),
+			       IMX586_HIST_BUCKETS - 1);
 
-    if(imx586->mono){
-        for (i = 0; i < ARRAY_SIZE(mono_codes); i++)
-            if (mono_codes[i] == code)
-                break;
-        return mono_codes[i];
-    }
-    else{
-        for (i = 0; i < ARRAY_SIZE(codes); i++)
-            if (codes[i] == code)
-                break;
-        return codes[i];
-    }
+	h->count++;
+	h->total_ns += ns;
+	h->max_ns = max(h->max_ns, ns);
+	h->bucket[b]++;
+}
 
-	
+static void imx586_stats_add(struct imx586 *imx586, enum imx586_stat stat,
+			     u64 start_ns)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&imx586->stats.lock, flags);
+	imx586_hist_add(&imx586->stats.hist[stat], ktime_get_ns() - start_ns);
+	spin_unlock_irqrestore(&imx586->stats.lock, flags);
 }
 
-static void imx586_set_default_format(struct imx586 *imx586)
+/* One bus write of @bytes register data bytes, started at @start_ns */
+static void imx586_stats_i2c(struct imx586 *imx586, unsigned int bytes,
+			     int ret, u64 start_ns)
 {
-	/* Set default mode to max resolution */
-	imx586->mode = &supported_modes_12bit[0];
-    if(imx586->mono){
-        imx586->fmt_code = MEDIA_BUS_FMT_Y12_1X12;
-    }
-    else{
-        imx586->fmt_code = MEDIA_BUS_FMT_SRGGB12_1X12;
-    }
-	
+	struct imx586_stats *st = &imx586->stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&st->lock, flags);
+	imx586_hist_add(&st->hist[IMX586_STAT_I2C_WRITE],
+			ktime_get_ns() - start_ns);
+	st->i2c_xfers++;
+	st->i2c_bytes += bytes;
+	if (ret < 0)
+		st->i2c_errors++;
+	spin_unlock_irqrestore(&st->lock, flags);
 }
 
-static int imx586_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+/*
+ * A write went through: the NACK run is over, and a long enough run of
+ * good writes lets the bursts grow back towards IMX586_MAX_BURST_LEN.
+ */
+static void imx586_i2c_ok(struct imx586 *imx586)
 {
-	struct imx586 *imx586 = to_imx586(sd);
-	struct v4l2_mbus_framefmt *try_fmt_img =
-		v4l2_subdev_get_try_format(sd, fh->state, IMAGE_PAD);
-	struct v4l2_mbus_framefmt *try_fmt_meta =
-		v4l2_subdev_get_try_format(sd, fh->state, METADATA_PAD);
-	struct v4l2_rect *try_crop;
+	struct imx586_stats *st = &imx586->stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&st->lock, flags);
+	imx586->i2c_nacks = 0;
+	if (imx586->burst_limit < IMX586_MAX_BURST_LEN &&
+	    ++imx586->i2c_clean >= IMX586_I2C_CLEAN_LIMIT) {
+		imx586->burst_limit = min(imx586->burst_limit * 2,
+					  (unsigned int)IMX586_MAX_BURST_LEN);
+		imx586->i2c_clean = 0;
+	}
+	spin_unlock_irqrestore(&st->lock, flags);
+}
 
-	mutex_lock(&imx586->mutex);
+/*
+ * Decide whether a failed write should be sent again. A NACK or a lost
+ * arbitration is retried a few times. If NACKs keep coming, the bursts
+ * are shortened, as on a marginal bus the long auto-increment writes fail
+ * first.
+ */
+static bool imx586_i2c_retry(struct imx586 *imx586, int ret, unsigned int try)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct imx586_stats *st = &imx586->stats;
+	unsigned int limit = 0;
+	unsigned long flags;
+
+	if (ret != -ENXIO && ret != -EREMOTEIO && ret != -EIO && ret != -EAGAIN)
+		return false;
+	if (try >= IMX586_I2C_RETRIES)
+		return false;
+
+	spin_lock_irqsave(&st->lock, flags);
+	st->i2c_retries++;
+	imx586->i2c_clean = 0;
+	if (++imx586->i2c_nacks >= IMX586_I2C_NACK_LIMIT &&
+	    imx586->burst_limit > 1) {
+		imx586->burst_limit /= 2;
+		imx586->i2c_nacks = 0;
+		limit = imx586->burst_limit;
+	}
+	spin_unlock_irqrestore(&st->lock, flags);
 
-	/* Initialize try_fmt for the image pad */
-	try_fmt_img->width = supported_modes_12bit[0].width;
-	try_fmt_img->height = supported_modes_12bit[0].height;
-    if(imx586->mono){
-        try_fmt_img->code = imx586_get_format_code(imx586, MEDIA_BUS_FMT_Y12_1X12);
-    }
-    else{
-        try_fmt_img->code = imx586_get_format_code(imx586, MEDIA_BUS_FMT_SRGGB12_1X12);
-    }
-	
-	try_fmt_img->field = V4L2_FIELD_NONE;
+	if (limit)
+		dev_warn(&client->dev,
+			 "repeated NACKs at %u Hz, bursts limited to %u registers\n",
+			 imx586->i2c_hz, limit);
 
-	/* Initialize try_fmt for the embedded metadata pad */
-	try_fmt_meta->width = IMX586_EMBEDDED_LINE_WIDTH;
-	try_fmt_meta->height = IMX586_NUM_EMBEDDED_LINES;
-	try_fmt_meta->code = MEDIA_BUS_FMT_SENSOR_DATA;
-	try_fmt_meta->field = V4L2_FIELD_NONE;
+	usleep_range(IMX586_I2C_RETRY_DELAY_US, 2 * IMX586_I2C_RETRY_DELAY_US);
 
-	/* Initialize try_crop */
-	try_crop = v4l2_subdev_get_try_crop(sd, fh->state, IMAGE_PAD);
-	try_crop->left = IMX586_PIXEL_ARRAY_LEFT;
-	try_crop->top = IMX586_PIXEL_ARRAY_TOP;
-	try_crop->width = IMX586_PIXEL_ARRAY_WIDTH;
-	try_crop->height = IMX586_PIXEL_ARRAY_HEIGHT;
+	return true;
+}
 
-	mutex_unlock(&imx586->mutex);
+/* Longest auto-increment write, from burst_len and NACK fallbacks */
+static unsigned int imx586_max_burst(struct imx586 *imx586)
+{
+	unsigned int len = imx586->burst_len ?: READ_ONCE(burst_len);
 
-	return 0;
+	return min(clamp_t(unsigned int, len, 1, IMX586_MAX_BURST_LEN),
+		   READ_ONCE(imx586->burst_limit));
 }
 
+static void imx586_stats_ctrl(struct imx586 *imx586, u32 id, u64 start_ns)
+{
+	unsigned long flags;
+	unsigned int i;
 
-static u64 calculate_v4l2_cid_exposure(u64 hmax, u64 vmax, u64 shr, u64 svr, u64 offset) {
-    u64 numerator;
-    numerator = (vmax * (svr + 1) - shr) * hmax + offset;
+	for (i = 0; i < ARRAY_SIZE(imx586_stat_ctrls); i++)
+		if (imx586_stat_ctrls[i].id == id)
+			break;
+	if (i == ARRAY_SIZE(imx586_stat_ctrls))
+		return;
 
-    do_div(numerator, hmax);
-    numerator = clamp_t(uint32_t, numerator, 0, 0xFFFFFFFF);
-    return numerator;
+	spin_lock_irqsave(&imx586->stats.lock, flags);
+	imx586_hist_add(&imx586->stats.ctrl[i], ktime_get_ns() - start_ns);
+	spin_unlock_irqrestore(&imx586->stats.lock, flags);
 }
 
-static void calculate_min_max_v4l2_cid_exposure(u64 hmax, u64 vmax, u64 min_shr, u64 svr, u64 offset, u64 *min_exposure, u64 *max_exposure) {
-    u64 max_shr = (svr + 1) * vmax - 4;
-    max_shr = min_t(uint64_t, max_shr, 0xFFFF);
+/* Write a 1 to 3 byte little-endian field, skipped if already programmed */
+static int imx586_write_reg(struct imx586 *imx586, u16 reg, u32 val,
+			    unsigned int len)
+{
+	u8 buf[3];
+	unsigned int i, try;
+	bool changed = false;
+	u64 start;
+	int ret;
 
-    *min_exposure = calculate_v4l2_cid_exposure(hmax, vmax, max_shr, svr, offset);
-    *max_exposure = calculate_v4l2_cid_exposure(hmax, vmax, min_shr, svr, offset);
-}
+	for (i = 0; i < len; i++) {
+		buf[i] = val >> (8 * i);
+		changed |= !imx586_reg_programmed(imx586, reg + i, buf[i]);
+	}
 
+	if (!changed)
+		return 0;
 
-/*
-Integration Time [s] = [{VMAX × (SVR + 1) – (SHR)}
- × HMAX + offset] / (72 × 10^6)
+	for (try = 0; ; try++) {
+		start = ktime_get_ns();
+		ret = regmap_bulk_write(imx586->regmap, reg, buf, len);
+		imx586_stats_i2c(imx586, 2 + len, ret, start);
+		trace_imx586_i2c_write(v4l2_get_subdevdata(&imx586->sd), reg,
+				       len, ret);
+		if (!ret) {
+			imx586_i2c_ok(imx586);
+			imx586_reg_record(imx586, reg, buf, len);
+			break;
+		}
+		if (!imx586_i2c_retry(imx586, ret, try))
+			break;
+	}
+	if (ret)
+		imx586_reg_invalidate(imx586, reg, len);
 
-Integration Time [s] = exposure * HMAX / (72 × 10^6)
-*/
+	return ret;
+}
 
-static uint32_t calculate_shr(uint32_t exposure, uint32_t hmax, uint64_t vmax, uint32_t svr, uint32_t offset)
+/* Write registers 1 byte at a time */
+static int imx586_write_reg_1byte(struct imx586 *imx586, u16 reg, u8 val)
 {
-    uint64_t temp;
-    uint32_t shr;
+	return imx586_write_reg(imx586, reg, val, 1);
+}
 
-    temp = ((uint64_t)exposure * hmax - offset);
-    do_div(temp, hmax);
-    shr = (uint32_t)(vmax * (svr + 1) - temp);
+/* Write registers 2 byte at a time */
+static int imx586_write_reg_2byte(struct imx586 *imx586, u16 reg, u16 val)
+{
+	return imx586_write_reg(imx586, reg, val, 2);
+}
 
-    return shr;
+/* Write registers 3 byte at a time */
+static int imx586_write_reg_3byte(struct imx586 *imx586, u16 reg, u32 val)
+{
+	return imx586_write_reg(imx586, reg, val, 3);
 }
 
-static int imx586_set_ctrl(struct v4l2_ctrl *ctrl)
+/* Send @n consecutive registers from @reg on as one auto-increment write */
+static int imx586_write_burst(struct imx586 *imx586, u16 reg, const u8 *buf,
+			      unsigned int n)
 {
-	struct imx586 *imx586 = container_of(ctrl->handler, struct imx586, ctrl_handler);
 	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-	const struct imx586_mode *mode = imx586->mode;
-
-	int ret = 0;
-
-	/*
-	 * The VBLANK control may change the limits of usable exposure, so check
-	 * and adjust if necessary.
-	 */
-	if (ctrl->id == V4L2_CID_VBLANK){
-		/* Honour the VBLANK limits when setting exposure. */
-		u64 current_exposure, max_exposure, min_exposure, vmax;
-		vmax = ((u64)mode->height + ctrl->val) ;
-		imx586 -> VMAX = vmax;
-		
-		calculate_min_max_v4l2_cid_exposure(imx586 -> HMAX, imx586 -> VMAX, (u64)mode->min_SHR, 0, 209, &min_exposure, &max_exposure);
-		current_exposure = clamp_t(uint32_t, current_exposure, min_exposure, max_exposure);
-
-		dev_info(&client->dev,"exposure_max:%lld, exposure_min:%lld, current_exposure:%lld\n",max_exposure, min_exposure, current_exposure);
-		dev_info(&client->dev,"\tVMAX:%d, HMAX:%d\n",imx586->VMAX, imx586->HMAX);
-		__v4l2_ctrl_modify_range(imx586->exposure, min_exposure,max_exposure, 1,current_exposure);
-	}
-
-	/*
-	 * Applying V4L2 control value only happens
-	 * when power is up for streaming
-	 */
-	if (pm_runtime_get_if_in_use(&client->dev) == 0)
-		return 0;
-
-	switch (ctrl->id) {
-	case V4L2_CID_EXPOSURE:
-		{
-			u64 shr;
-			dev_info(&client->dev,"V4L2_CID_EXPOSURE : %d\n",ctrl->val);
-			dev_info(&client->dev,"\tvblank:%d, hblank:%d\n",imx586->vblank->val, imx586->hblank->val);
-			dev_info(&client->dev,"\tVMAX:%d, HMAX:%d\n",imx586->VMAX, imx586->HMAX);
-			shr = calculate_shr(ctrl->val, imx586->HMAX, imx586->VMAX, 0, 209);
-			dev_info(&client->dev,"\tSHR:%lld\n",shr);
-			ret = imx586_write_reg_2byte(imx586, IMX586_REG_SHR, shr);
-		}
-		break;
-	case V4L2_CID_ANALOGUE_GAIN:
-		{
-			int gain = ctrl->val;
-
-			// Use HCG mode when gain is over the HGC level
-			// This can only be done when HDR is disabled
-			bool useHGC = false;
-			if (!mode->hdr && gain >= IMX586_ANA_GAIN_HCG_THRESHOLD) {
-				useHGC = true;
-				gain -= IMX586_ANA_GAIN_HCG_LEVEL;
-				if ( gain < IMX586_ANA_GAIN_HCG_MIN )
-					gain = IMX586_ANA_GAIN_HCG_MIN;
-			}
-			dev_info(&client->dev,"V4L2_CID_ANALOGUE_GAIN: %d, HGC: %d\n",gain, (int)useHGC);
+	unsigned int try;
+	u64 start;
+	int ret;
 
-			// Apply gain
-			imx586_register_hold(imx586, true);
-			ret = imx586_write_reg_2byte(imx586, IMX586_REG_ANALOG_GAIN, gain);
-			if (ret)
-				dev_err_ratelimited(&client->dev, "Failed to write reg 0x%4.4x. error = %d\n", IMX586_REG_ANALOG_GAIN, ret);
-			
-			// Set HGC/LCG channel			
-			ret = imx586_write_reg_1byte(imx586, IMX586_REG_FDG_SEL0, (u16)(useHGC ? 0x01 : 0x00));
-			imx586_register_hold(imx586, false);
-		}
-		break;
-	case V4L2_CID_VBLANK:
-		{
-			dev_info(&client->dev,"V4L2_CID_VBLANK : %d\n",ctrl->val);
-			imx586->VMAX = ((u64)mode->height + ctrl->val);
-			dev_info(&client->dev,"\tVMAX : %d\n",imx586 -> VMAX);
-			ret = imx586_write_reg_3byte(imx586, IMX586_REG_VMAX, imx586 -> VMAX);
-		}
-		break;
-	case V4L2_CID_HBLANK:
-		{
-			u64 pixel_rate;
-			u64 hmax;
-			dev_info(&client->dev,"V4L2_CID_HBLANK : %d\n",ctrl->val);
-			pixel_rate = (u64)mode->width * IMX586_PIXEL_RATE;
-			do_div(pixel_rate,mode->min_HMAX);
-			hmax = (u64)(mode->width + ctrl->val) * IMX586_PIXEL_RATE;
-			do_div(hmax,pixel_rate);
-			imx586 -> HMAX = hmax;
-			dev_info(&client->dev,"\tHMAX : %d\n",imx586 -> HMAX);
-			ret = imx586_write_reg_2byte(imx586, IMX586_REG_HMAX, hmax);
+	for (try = 0; ; try++) {
+		start = ktime_get_ns();
+		ret = regmap_bulk_write(imx586->regmap, reg, buf, n);
+		imx586_stats_i2c(imx586, 2 + n, ret, start);
+		trace_imx586_i2c_write(client, reg, n, ret);
+		if (!ret) {
+			imx586_i2c_ok(imx586);
+			imx586_reg_record(imx586, reg, buf, n);
+			return 0;
 		}
-		break;
-    case V4L2_CID_HFLIP:
-		ret = imx586_write_reg_1byte(imx586, IMX586_FLIP_WINMODEH, ctrl->val);
-		break;
-	case V4L2_CID_VFLIP:
-		ret = imx586_write_reg_1byte(imx586, IMX586_FLIP_WINMODEV, ctrl->val);
-		break;
-	default:
-		dev_info(&client->dev,
-			 "ctrl(id:0x%x,val:0x%x) is not handled\n",
-			 ctrl->id, ctrl->val);
-		//ret = -EINVAL;
-		break;
+		if (!imx586_i2c_retry(imx586, ret, try))
+			break;
 	}
 
-	pm_runtime_put(&client->dev);
+	imx586_reg_invalidate(imx586, reg, n);
+	dev_err_ratelimited(&client->dev,
+			    "Failed to write reg 0x%4.4x (%u regs). error = %d\n",
+			    reg, n, ret);
 
 	return ret;
 }
 
-static const struct v4l2_ctrl_ops imx586_ctrl_ops = {
-	.s_ctrl = imx586_set_ctrl,
-};
-
-static int imx586_enum_mbus_code(struct v4l2_subdev *sd,
-				 struct v4l2_subdev_state *sd_state,
-				 struct v4l2_subdev_mbus_code_enum *code)
+/*
+ * Write a list of 1 byte registers. Runs of consecutive addresses are sent
+ * as a single regmap_bulk_write() of up to burst_len registers, and
+ * registers the shadow says are already programmed are left out.
+ */
+static int imx586_write_regs(struct imx586 *imx586,
+			     const struct imx586_reg *regs, u32 len)
 {
-	struct imx586 *imx586 = to_imx586(sd);
+	u8 buf[IMX586_MAX_BURST_LEN];
+	unsigned int i, n;
+	int ret;
 
-	if (code->pad >= NUM_PADS)
-		return -EINVAL;
+	for (i = 0; i < len; i += n) {
+		unsigned int max_burst = imx586_max_burst(imx586);
+		unsigned int changed;
 
-	if (code->pad == IMAGE_PAD) {
-        if(imx586->mono){
-            if (code->index >= (ARRAY_SIZE(mono_codes)))
-                return -EINVAL;
+		if (imx586_reg_programmed(imx586, regs[i].address, regs[i].val)) {
+			n = 1;
+			continue;
+		}
+
+		buf[0] = regs[i].val;
+		changed = 1;
+
+		/*
+		 * Unchanged registers inside a run cost a byte each, far less
+		 * than starting a new transfer, so only trailing ones are cut.
+		 */
+		for (n = 1; i + n < len && n < max_burst; n++) {
+			if (regs[i + n].address != regs[i].address + n)
+				break;
+			buf[n] = regs[i + n].val;
+			if (!imx586_reg_programmed(imx586, regs[i + n].address,
+						   regs[i + n].val))
+				changed = n + 1;
+		}
+
+		ret = imx586_write_burst(imx586, regs[i].address, buf, changed);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Write @num_regs registers packed as firmware bursts of { le16 address,
+ * u8 length, data }, split at burst_len and with the already programmed
+ * registers left out as in imx586_write_regs().
+ */
+static int imx586_write_bursts(struct imx586 *imx586, const u8 *p,
+			       unsigned int num_regs)
+{
+	unsigned int done, len, i, n;
+	u16 addr;
+	int ret;
+
+	for (done = 0; done < num_regs; done += len, p += 3 + len) {
+		addr = get_unaligned_le16(p);
+		len = p[2];
+
+		for (i = 0; i < len; i += n) {
+			unsigned int max_burst = imx586_max_burst(imx586);
+			unsigned int changed = 1;
+
+			if (imx586_reg_programmed(imx586, addr + i, p[3 + i])) {
+				n = 1;
+				continue;
+			}
+
+			for (n = 1; i + n < len && n < max_burst; n++)
+				if (!imx586_reg_programmed(imx586, addr + i + n,
+							   p[3 + i + n]))
+					changed = n + 1;
+
+			ret = imx586_write_burst(imx586, addr + i, &p[3 + i],
+						 changed);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int imx586_write_reg_list(struct imx586 *imx586,
+				 const struct IMX586_reg_list *list)
+{
+	if (list->bursts)
+		return imx586_write_bursts(imx586, list->bursts,
+					   list->num_of_regs);
+
+	return imx586_write_regs(imx586, list->regs, list->num_of_regs);
+}
+
+/* Hold register values until hold is disabled */
+static inline void imx586_register_hold(struct imx586 *imx586, bool hold)
+{
+	imx586_write_reg_1byte(imx586, IMX586_REG_REGHOLD, hold ? 1 : 0);
+}
+
+static void imx586_txn_init(struct imx586 *imx586, struct imx586_txn *txn)
+{
+	txn->imx586 = imx586;
+	txn->client = v4l2_get_subdevdata(&imx586->sd);
+	txn->num_msgs = 0;
+	txn->num_writes = 0;
+	txn->used = 0;
+	txn->error = 0;
+	txn->async_pending = 0;
+}
+
+/*
+ * Queue a write of a 1 to 3 byte little-endian register field. Fields the
+ * shadow says are already programmed are not queued.
+ */
+static void imx586_txn_write(struct imx586_txn *txn, u16 reg, u32 val,
+			     unsigned int len)
+{
+	struct i2c_msg *msg;
+	u8 *buf;
+	unsigned int i;
+	bool changed = false;
+
+	if (txn->error)
+		return;
+
+	for (i = 0; i < len; i++)
+		changed |= !imx586_reg_programmed(txn->imx586, reg + i,
+						  (val >> (8 * i)) & 0xff);
+	if (!changed)
+		return;
+
+	if (txn->num_msgs == IMX586_TXN_MAX_MSGS ||
+	    txn->used + 2 + len > sizeof(txn->buf)) {
+		txn->error = -ENOSPC;
+		return;
+	}
+
+	buf = &txn->buf[txn->used];
+	put_unaligned_be16(reg, buf);
+	for (i = 0; i < len; i++)
+		buf[2 + i] = val >> (8 * i);
+
+	msg = &txn->msgs[txn->num_msgs++];
+	msg->addr = txn->client->addr;
+	msg->flags = 0;
+	msg->len = 2 + len;
+	msg->buf = buf;
+
+	txn->used += 2 + len;
+	if (reg != IMX586_REG_REGHOLD)
+		txn->num_writes++;
+}
+
+static inline void imx586_txn_hold(struct imx586_txn *txn, bool hold)
+{
+	imx586_txn_write(txn, IMX586_REG_REGHOLD, hold ? 1 : 0, 1);
+}
+
+/*
+ * regmap-i2c has no multi-message primitive, so transactions go straight to
+ * i2c_transfer() and are recorded in the shadow afterwards.
+ */
+static void imx586_txn_update_shadow(struct imx586_txn *txn)
+{
+	unsigned int i;
+
+	for (i = 0; i < txn->num_msgs; i++)
+		imx586_reg_record(txn->imx586,
+				  get_unaligned_be16(txn->msgs[i].buf),
+				  txn->msgs[i].buf + 2, txn->msgs[i].len - 2);
+}
+
+/* Send @n queued messages from @i as one transfer, resending on NACK */
+static int imx586_txn_send(struct imx586_txn *txn, unsigned int i,
+			   unsigned int n)
+{
+	struct i2c_adapter *adap = txn->client->adapter;
+	unsigned int bytes = 0, j, try;
+	u64 start;
+	int ret;
+
+	for (j = i; j < i + n; j++)
+		bytes += txn->msgs[j].len;
+
+	/* Every message is a plain register write, safe to resend */
+	for (try = 0; ; try++) {
+		start = ktime_get_ns();
+		ret = i2c_transfer(adap, &txn->msgs[i], n);
+		if (ret == n)
+			ret = 0;
+		else if (ret >= 0)
+			ret = -EIO;
+		imx586_stats_i2c(txn->imx586, bytes, ret, start);
+		if (!ret) {
+			imx586_i2c_ok(txn->imx586);
+			break;
+		}
+		if (!imx586_i2c_retry(txn->imx586, ret, try))
+			break;
+	}
+
+	return ret;
+}
+
+/*
+ * Send all queued writes as one transfer. A hold window must not be split
+ * across transfers, so adapters limited to fewer messages get the plain
+ * sequential path instead, one write per transfer.
+ */
+static int imx586_txn_commit(struct imx586_txn *txn)
+{
+	struct i2c_adapter *adap = txn->client->adapter;
+	unsigned int n = txn->num_msgs;
+	unsigned int i;
+	int ret;
+
+	if (txn->error)
+		return txn->error;
+
+	/* Nothing left once unchanged fields are dropped: skip the hold too */
+	if (!txn->num_writes)
+		return 0;
+
+	if (adap->quirks && adap->quirks->max_num_msgs &&
+	    adap->quirks->max_num_msgs < txn->num_msgs)
+		n = 1;
+
+	for (i = 0; i < txn->num_msgs; i += n) {
+		ret = imx586_txn_send(txn, i, n);
+		if (ret) {
+			dev_err_ratelimited(&txn->client->dev,
+					    "Failed to write reg 0x%4.4x. error = %d\n",
+					    get_unaligned_be16(txn->msgs[i].buf), ret);
+			goto err_invalidate;
+		}
+	}
+
+	for (i = 0; i < txn->num_msgs; i++)
+		trace_imx586_i2c_write(txn->client,
+				       get_unaligned_be16(txn->msgs[i].buf),
+				       txn->msgs[i].len - 2, 0);
+
+	imx586_txn_update_shadow(txn);
+
+	return 0;
+
+err_invalidate:
+	/*
+	 * The hold on may have gone out. A sensor left in register hold
+	 * ignores every later update, so release it whatever else failed.
+	 */
+	if (get_unaligned_be16(txn->msgs[0].buf) == IMX586_REG_REGHOLD &&
+	    txn->msgs[0].buf[2])
+		imx586_register_hold(txn->imx586, false);
+
+	/* A partial transfer leaves the sensor state unknown */
+	for (i = 0; i < txn->num_msgs; i++)
+		imx586_reg_invalidate(txn->imx586,
+				      get_unaligned_be16(txn->msgs[i].buf),
+				      txn->msgs[i].len - 2);
+
+	return ret;
+}
+
+/*
+ * Media bus code the sensor outputs for @code's depth. The readout start
+ * follows WINMODEH/WINMODEV, so flips keep the RGGB order and each depth
+ * has a single code. Unknown codes fall back to the default 12-bit one.
+ * Only looks at the constant code tables, so needs no locking.
+ */
+static u32 imx586_get_format_code(struct imx586 *imx586, u32 code)
+{
+	int depth = imx586_code_depth(imx586, code);
+
+	if (depth < 0)
+		depth = IMX586_DEPTH_12;
+
+	return imx586->mono ? mono_codes[depth] : codes[depth * 4];
+}
+
+/*
+ * Binned modes read the whole array, only all-pixel modes can window.
+ * DOL timing is tied to the full frame height, so it keeps it too.
+ */
+static bool imx586_mode_can_window(const struct imx586_mode *mode)
+{
+	return mode->width >= IMX586_PIXEL_ARRAY_WIDTH && !mode->dol;
+}
+
+static bool imx586_window_active(struct imx586 *imx586)
+{
+	return !v4l2_rect_equal(&imx586->crop, &imx586->mode->crop);
+}
+
+/* Modes such as 720p are themselves read out of a window */
+static bool imx586_crop_is_full(const struct v4l2_rect *r)
+{
+	return r->width == IMX586_PIXEL_ARRAY_WIDTH &&
+	       r->height == IMX586_PIXEL_ARRAY_HEIGHT;
+}
+
+/* Drop any window and output the current mode's full frame */
+static void imx586_reset_window(struct imx586 *imx586)
+{
+	imx586->crop = imx586->mode->crop;
+	imx586->width = imx586->mode->width;
+	imx586->height = imx586->mode->height;
+}
+
+/* Align a requested crop to what the window readout supports */
+static void imx586_adjust_crop(struct v4l2_rect *r)
+{
+	r->width = clamp_t(u32, ALIGN_DOWN(r->width, IMX586_WINDOW_H_STEP),
+			   IMX586_WINDOW_MIN_WIDTH, IMX586_PIXEL_ARRAY_WIDTH);
+	r->height = clamp_t(u32, ALIGN_DOWN(r->height, IMX586_WINDOW_V_STEP),
+			    IMX586_WINDOW_MIN_HEIGHT, IMX586_PIXEL_ARRAY_HEIGHT);
+
+	/* Even offsets keep the Bayer order */
+	r->left = clamp_t(s32, ALIGN_DOWN(r->left, 2), IMX586_PIXEL_ARRAY_LEFT,
+			  IMX586_PIXEL_ARRAY_LEFT + IMX586_PIXEL_ARRAY_WIDTH -
+			  r->width);
+	r->top = clamp_t(s32, ALIGN_DOWN(r->top, 2), IMX586_PIXEL_ARRAY_TOP,
+			 IMX586_PIXEL_ARRAY_TOP + IMX586_PIXEL_ARRAY_HEIGHT -
+			 r->height);
+}
+
+static void imx586_publish_active(struct imx586 *imx586)
+{
+	write_seqlock(&imx586->active_lock);
+	imx586->active.mode = imx586->mode;
+	imx586->active.code = imx586->fmt_code;
+	imx586->active.width = imx586->width;
+	imx586->active.height = imx586->height;
+	imx586->active.crop = imx586->crop;
+	write_sequnlock(&imx586->active_lock);
+}
+
+/* Lockless read of the active format, retried if a writer got in */
+static void imx586_read_active(struct imx586 *imx586,
+			       struct imx586_active_fmt *active)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&imx586->active_lock);
+		*active = imx586->active;
+	} while (read_seqretry(&imx586->active_lock, seq));
+}
+
+static void imx586_set_default_format(struct imx586 *imx586)
+{
+	/* Set default mode to max resolution */
+	imx586->mode = &supported_modes_12bit[0];
+	imx586_reset_window(imx586);
+    if(imx586->mono){
+        imx586->fmt_code = MEDIA_BUS_FMT_Y12_1X12;
+    }
+    else{
+        imx586->fmt_code = MEDIA_BUS_FMT_SRGGB12_1X12;
+    }
+
+	imx586_publish_active(imx586);
+}
+
+static int imx586_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+	struct v4l2_mbus_framefmt *try_fmt_img =
+		v4l2_subdev_get_try_format(sd, fh->state, IMAGE_PAD);
+	struct v4l2_mbus_framefmt *try_fmt_meta =
+		v4l2_subdev_get_try_format(sd, fh->state, METADATA_PAD);
+	struct v4l2_rect *try_crop;
+
+	mutex_lock(&imx586->mutex);
+
+	/* Initialize try_fmt for the image pad */
+	try_fmt_img->width = supported_modes_12bit[0].width;
+	try_fmt_img->height = supported_modes_12bit[0].height;
+    if(imx586->mono){
+        try_fmt_img->code = imx586_get_format_code(imx586, MEDIA_BUS_FMT_Y12_1X12);
+    }
+    else{
+        try_fmt_img->code = imx586_get_format_code(imx586, MEDIA_BUS_FMT_SRGGB12_1X12);
+    }
+	
+	try_fmt_img->field = V4L2_FIELD_NONE;
+
+	/* Initialize try_fmt for the embedded metadata pad */
+	try_fmt_meta->width = IMX586_EMBEDDED_LINE_WIDTH;
+	try_fmt_meta->height = IMX586_NUM_EMBEDDED_LINES;
+	try_fmt_meta->code = MEDIA_BUS_FMT_SENSOR_DATA;
+	try_fmt_meta->field = V4L2_FIELD_NONE;
+
+	/* Initialize try_crop */
+	try_crop = v4l2_subdev_get_try_crop(sd, fh->state, IMAGE_PAD);
+	try_crop->left = IMX586_PIXEL_ARRAY_LEFT;
+	try_crop->top = IMX586_PIXEL_ARRAY_TOP;
+	try_crop->width = IMX586_PIXEL_ARRAY_WIDTH;
+	try_crop->height = IMX586_PIXEL_ARRAY_HEIGHT;
+
+	mutex_unlock(&imx586->mutex);
+
+	return 0;
+}
+
+
+/*
+ * Latch a new line length. The exposure offset only depends on HMAX, so
+ * its whole-line part is worked out here once instead of on every
+ * exposure update.
+ */
+static void imx586_update_hmax(struct imx586 *imx586, u32 hmax)
+{
+	imx586->HMAX = hmax;
+	imx586->exp_offset_lines = IMX586_EXPOSURE_OFFSET / hmax;
+	imx586->shr_offset_lines = DIV_ROUND_UP(IMX586_EXPOSURE_OFFSET, hmax);
+}
+
+/*
+ * HMAX = (width + hblank) * IMX586_PIXEL_RATE / pixel_rate, using the
+ * per-mode reciprocal. The estimate can only fall short, and the
+ * correction step brings it up to the exact quotient.
+ */
+static u32 imx586_hblank_to_hmax(struct imx586 *imx586, u32 hblank)
+{
+	u64 line = (u64)imx586->width + hblank;
+	u32 hmax = (line * imx586->line.hmax_recip) >> 32;
+
+	while ((u64)(hmax + 1) * imx586->line.pixel_rate <=
+	       line * IMX586_PIXEL_RATE)
+		hmax++;
+
+	return hmax;
+}
+
+/*
+Integration Time [s] = [{VMAX × (SVR + 1) – (SHR)}
+ × HMAX + offset] / (72 × 10^6)
+
+Integration Time [s] = exposure * HMAX / (72 × 10^6)
+*/
+
+static u64 calculate_v4l2_cid_exposure(struct imx586 *imx586, u64 vmax, u64 shr, u64 svr) {
+    return vmax * (svr + 1) - shr + imx586->exp_offset_lines;
+}
+
+static void calculate_min_max_v4l2_cid_exposure(struct imx586 *imx586, u64 vmax, u64 min_shr, u64 svr, u64 *min_exposure, u64 *max_exposure) {
+    u64 max_shr = (svr + 1) * vmax - 4;
+    max_shr = min_t(uint64_t, max_shr, IMX586_SHR_MAX);
+
+    /* calculate_shr() rounds the offset up, keep its result <= max_shr */
+    *min_exposure = calculate_v4l2_cid_exposure(imx586, vmax, max_shr, svr) +
+                    imx586->shr_offset_lines - imx586->exp_offset_lines;
+    *max_exposure = calculate_v4l2_cid_exposure(imx586, vmax, min_shr, svr);
+}
+
+static uint32_t calculate_shr(struct imx586 *imx586, uint32_t exposure, uint64_t vmax, uint32_t svr)
+{
+    return (uint32_t)(vmax * (svr + 1) - exposure + imx586->shr_offset_lines);
+}
+
+static const struct {
+	u16 reg;
+	u8 len;
+} imx586_async_regs[IMX586_ASYNC_NUM] = {
+	[IMX586_ASYNC_VMAX]	= { IMX586_REG_VMAX, 3 },
+	[IMX586_ASYNC_SHR]	= { IMX586_REG_SHR, 2 },
+	[IMX586_ASYNC_RHS1]	= { IMX586_REG_RHS1, 3 },
+	[IMX586_ASYNC_SHR1]	= { IMX586_REG_SHR1, 3 },
+	[IMX586_ASYNC_GAIN]	= { IMX586_REG_ANALOG_GAIN, 2 },
+	[IMX586_ASYNC_GAIN1]	= { IMX586_REG_ANALOG_GAIN1, 2 },
+	[IMX586_ASYNC_FDG_SEL0]	= { IMX586_REG_FDG_SEL0, 1 },
+	[IMX586_ASYNC_EXP_TH_H]	= { IMX586_REG_EXP_TH_H, 2 },
+	[IMX586_ASYNC_EXP_TH_L]	= { IMX586_REG_EXP_TH_L, 2 },
+	[IMX586_ASYNC_CCMP1]	= { IMX586_REG_CCMP1_EXP, 3 },
+	[IMX586_ASYNC_ACMP1]	= { IMX586_REG_ACMP1_EXP, 1 },
+	[IMX586_ASYNC_CCMP2]	= { IMX586_REG_CCMP2_EXP, 3 },
+	[IMX586_ASYNC_ACMP2]	= { IMX586_REG_ACMP2_EXP, 1 },
+	[IMX586_ASYNC_HMAX]	= { IMX586_REG_HMAX, 2 },
+	[IMX586_ASYNC_HFLIP]	= { IMX586_FLIP_WINMODEH, 1 },
+	[IMX586_ASYNC_VFLIP]	= { IMX586_FLIP_WINMODEV, 1 },
+};
+
+/* Send every pending slot inside one register hold window */
+static void imx586_ctrl_work(struct kthread_work *work)
+{
+	struct imx586 *imx586 = container_of(work, struct imx586, ctrl_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct imx586_txn txn;
+	u32 val[IMX586_ASYNC_NUM];
+	unsigned long pending, flags;
+	unsigned int i;
+	int ret;
+
+	pending = atomic_long_xchg(&imx586->async_pending, 0);
+	if (!pending)
+		return;
+
+	/* Pairs with the barrier in imx586_ctrl_commit() */
+	smp_mb__after_atomic();
+
+	if (pm_runtime_get_if_in_use(&client->dev) <= 0)
+		return;
+
+	imx586_txn_init(imx586, &txn);
+	imx586_txn_hold(&txn, true);
+	for_each_set_bit(i, &pending, IMX586_ASYNC_NUM) {
+		val[i] = READ_ONCE(imx586->async_val[i]);
+		imx586_txn_write(&txn, imx586_async_regs[i].reg, val[i],
+				 imx586_async_regs[i].len);
+	}
+	imx586_txn_hold(&txn, false);
+
+	ret = imx586_txn_commit(&txn);
+	if (ret) {
+		dev_err_ratelimited(&client->dev,
+				    "deferred control write failed (%d)\n", ret);
+	} else {
+		spin_lock_irqsave(&imx586->state_lock, flags);
+		for_each_set_bit(i, &pending, IMX586_ASYNC_NUM)
+			imx586->state_sent[i] = val[i];
+		spin_unlock_irqrestore(&imx586->state_lock, flags);
+	}
+
+	pm_runtime_put(&client->dev);
+}
+
+/*
+ * Store the newest value of a field for the worker, never touching the
+ * bus. The slot only becomes pending when the batch is committed.
+ */
+static void imx586_async_queue(struct imx586 *imx586, struct imx586_txn *txn,
+			       enum imx586_async_reg slot, u32 val)
+{
+	WRITE_ONCE(imx586->async_val[slot], val);
+	__set_bit(slot, &txn->async_pending);
+}
+
+static void imx586_async_kick(struct imx586 *imx586)
+{
+	if (atomic_long_read(&imx586->async_pending))
+		kthread_queue_work(imx586->ctrl_worker, &imx586->ctrl_work);
+}
+
+/*
+ * Wait until everything queued so far has reached the sensor. Stream
+ * and mode changes go through here before touching the bus themselves.
+ */
+static void imx586_async_flush(struct imx586 *imx586)
+{
+	if (!imx586->ctrl_worker)
+		return;
+
+	imx586_async_kick(imx586);
+	kthread_flush_work(&imx586->ctrl_work);
+}
+
+/*
+ * Frame start: report it to userspace and send the writes queued during
+ * the previous frame, so they all latch together on the next one.
+ */
+static irqreturn_t imx586_xvs_irq(int irq, void *data)
+{
+	struct imx586 *imx586 = data;
+	struct v4l2_event ev = {
+		.type = V4L2_EVENT_FRAME_SYNC,
+	};
+
+	u64 now = ktime_get_ns();
+	u64 last = imx586->xvs_last_ns;
+
+	if (last) {
+		WRITE_ONCE(imx586->xvs_prev_interval_ns,
+			   imx586->xvs_interval_ns);
+		WRITE_ONCE(imx586->xvs_interval_ns, now - last);
+	}
+	WRITE_ONCE(imx586->xvs_last_ns, now);
+
+	ev.u.frame_sync.frame_sequence = atomic_inc_return(&imx586->frame_seq);
+
+	/* Whatever was sent during the last frame latched on this one */
+	spin_lock(&imx586->state_lock);
+	memcpy(imx586->state_live, imx586->state_sent,
+	       sizeof(imx586->state_live));
+	imx586->live_seq = ev.u.frame_sync.frame_sequence;
+	spin_unlock(&imx586->state_lock);
+
+	v4l2_subdev_notify_event(&imx586->sd, &ev);
+
+	if (READ_ONCE(imx586->async_active))
+		imx586_async_kick(imx586);
+
+	return IRQ_HANDLED;
+}
+
+/* Either queue a field for the worker or add it to a synchronous batch */
+static void imx586_ctrl_write(struct imx586 *imx586, struct imx586_txn *txn,
+			      enum imx586_async_reg slot, u32 val)
+{
+	unsigned long flags;
+
+	if (imx586->async_active) {
+		imx586_async_queue(imx586, txn, slot, val);
+		return;
+	}
+
+	imx586_txn_write(txn, imx586_async_regs[slot].reg, val,
+			 imx586_async_regs[slot].len);
+
+	spin_lock_irqsave(&imx586->state_lock, flags);
+	imx586->state_sent[slot] = val;
+	spin_unlock_irqrestore(&imx586->state_lock, flags);
+}
+
+/* Commit a control batch, or hand it to the worker in deferred mode */
+static int imx586_ctrl_commit(struct imx586 *imx586, struct imx586_txn *txn)
+{
+	if (imx586->async_active) {
+		if (!txn->async_pending)
+			return 0;
+
+		/* The values must be visible before the worker sees the slots */
+		smp_mb__before_atomic();
+		atomic_long_or(txn->async_pending, &imx586->async_pending);
+
+		/* With XVS wired the frame start interrupt sends them */
+		if (!imx586->xvs_irq)
+			imx586_async_kick(imx586);
+		return 0;
+	}
+
+	return imx586_txn_commit(txn);
+}
+
+/* DOL frames span two VMAX periods, imx586->VMAX holds FSC there */
+static u32 imx586_vmax_reg(struct imx586 *imx586)
+{
+	return imx586->mode->dol ? imx586->VMAX / 2 : imx586->VMAX;
+}
+
+/*
+ * Place the DOL short exposure: the smallest RHS1 that fits it after
+ * SHR1_MIN, pulled in to the end of the frame if the frame is too short.
+ */
+static void imx586_dol_short_exposure(struct imx586 *imx586, u32 *rhs1,
+				      u32 *shr1)
+{
+	u32 offset = imx586->shr_offset_lines;
+	u32 exposure = imx586->short_exposure->val;
+	u32 rhs1_max, need;
+
+	rhs1_max = imx586->VMAX - 2 * imx586->height;
+	rhs1_max = rounddown(rhs1_max - 1, IMX586_DOL_RHS1_STEP) + 1;
+
+	need = max_t(u32, exposure + IMX586_DOL_SHR1_MIN, offset + 1) - offset;
+	*rhs1 = roundup(need - 1, IMX586_DOL_RHS1_STEP) + 1;
+	if (*rhs1 > rhs1_max) {
+		*rhs1 = rhs1_max;
+		exposure = *rhs1 + offset - IMX586_DOL_SHR1_MIN;
+	}
+
+	*shr1 = *rhs1 + offset - exposure;
+}
+
+/* Exposure the current frame allows, after the DOL short frame if any */
+static void imx586_exposure_limits(struct imx586 *imx586, u64 *min_exposure,
+				   u64 *max_exposure)
+{
+	u64 min_shr = imx586->mode->min_SHR;
+	u32 rhs1, shr1;
+
+	if (imx586->mode->dol) {
+		imx586_dol_short_exposure(imx586, &rhs1, &shr1);
+		min_shr = max_t(u64, min_shr, rhs1 + IMX586_DOL_SHR0_MARGIN);
+	}
+
+	calculate_min_max_v4l2_cid_exposure(imx586, imx586->VMAX, min_shr, 0,
+					    min_exposure, max_exposure);
+}
+
+/*
+ * Narrow V4L2_CID_EXPOSURE to the current frame. Exposure is in the VBLANK
+ * cluster, and changing its range from s_ctrl would overwrite the pending
+ * new value, so this runs from the control notify once the cluster is
+ * applied. An exposure outside the new range is clamped and set again.
+ */
+static void imx586_update_exposure_range(struct imx586 *imx586)
+{
+	u64 min_exposure, max_exposure;
+
+	imx586_exposure_limits(imx586, &min_exposure, &max_exposure);
+	__v4l2_ctrl_modify_range(imx586->exposure, min_exposure, max_exposure,
+				 IMX586_EXPOSURE_STEP,
+				 clamp_t(u64, IMX586_EXPOSURE_DEFAULT,
+					 min_exposure, max_exposure));
+}
+
+static void imx586_ctrl_notify(struct v4l2_ctrl *ctrl, void *priv)
+{
+	imx586_update_exposure_range(priv);
+}
+
+/*
+ * Apply the EXPOSURE, ANALOGUE_GAIN and VBLANK cluster, with the short
+ * frame exposure and gain in DOL modes. VMAX, the shutters and the gain
+ * registers are written together inside one register hold window, so the
+ * sensor latches them on the same frame.
+ */
+static int imx586_set_exposure_cluster(struct imx586 *imx586)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	const struct imx586_mode *mode = imx586->mode;
+	struct imx586_txn txn;
+	u64 min_exposure, max_exposure;
+	u32 exposure, shr, rhs1, shr1;
+	bool short_new = mode->dol && imx586->short_exposure->is_new;
+
+	imx586_txn_init(imx586, &txn);
+	imx586_txn_hold(&txn, true);
+
+	if (imx586->vblank->is_new)
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_VMAX,
+				  imx586_vmax_reg(imx586));
+
+	/* The short frame is read out before the long one may start */
+	if (mode->dol) {
+		imx586_dol_short_exposure(imx586, &rhs1, &shr1);
+
+		if (short_new || imx586->vblank->is_new) {
+			imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_RHS1, rhs1);
+			imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_SHR1, shr1);
+		}
+	}
+
+	/* SHR counts from the end of the frame, so it follows VMAX too */
+	if (imx586->exposure->is_new || imx586->vblank->is_new || short_new) {
+		/*
+		 * Honour the VBLANK limits when setting exposure. The control
+		 * range follows once the cluster is applied, see
+		 * imx586_update_exposure_range().
+		 */
+		imx586_exposure_limits(imx586, &min_exposure, &max_exposure);
+		exposure = clamp_t(u32, imx586->exposure->val,
+				   min_exposure, max_exposure);
+		shr = calculate_shr(imx586, exposure, imx586->VMAX, 0);
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_SHR, shr);
+
+		trace_imx586_set_exposure(client, exposure, shr, imx586->VMAX,
+					  imx586->HMAX);
+	}
+
+	if (imx586->gain->is_new) {
+		int gain = imx586->gain->val;
+
+		// Use HCG mode when gain is over the HGC level
+		// This can only be done when HDR is disabled
+		// DOL shares FDG_SEL0 between both frames, so stays in LCG
+		bool useHGC = false;
+		if (!mode->hdr && !mode->dol && gain >= IMX586_ANA_GAIN_HCG_THRESHOLD) {
+			useHGC = true;
+			gain -= IMX586_ANA_GAIN_HCG_LEVEL;
+			if ( gain < IMX586_ANA_GAIN_HCG_MIN )
+				gain = IMX586_ANA_GAIN_HCG_MIN;
+		}
+
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_GAIN, gain);
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_FDG_SEL0,
+				  useHGC ? 0x01 : 0x00);
+
+		trace_imx586_set_gain(client, gain, useHGC);
+	}
+
+	if (mode->dol && imx586->short_gain->is_new)
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_GAIN1,
+				  imx586->short_gain->val);
+
+	imx586_txn_hold(&txn, false);
+
+	return imx586_ctrl_commit(imx586, &txn);
+}
+
+static int imx586_set_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct imx586 *imx586 = container_of(ctrl->handler, struct imx586, ctrl_handler);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct imx586_txn txn;
+	unsigned int i;
+	u64 start;
+	int ret = 0;
+
+	/* Callers needing synchronous semantics wait here for the worker */
+	if (ctrl->id == IMX586_CID_CTRL_FENCE) {
+		imx586_async_flush(imx586);
+		return 0;
+	}
+
+	/* Programmed at stream on, and grabbed while streaming */
+	if (ctrl->id == IMX586_CID_SYNC_MODE) {
+		imx586->sync_mode = ctrl->val;
+		return 0;
+	}
+
+	/* Track the frame and line length even while powered down */
+	if (ctrl == imx586->exposure)
+		imx586->VMAX = (u64)imx586->height + imx586->vblank->val;
+	else if (ctrl == imx586->hblank)
+		imx586_update_hmax(imx586,
+				   imx586_hblank_to_hmax(imx586, ctrl->val));
+
+	/*
+	 * Applying V4L2 control value only happens
+	 * when power is up for streaming
+	 */
+	if (pm_runtime_get_if_in_use(&client->dev) == 0)
+		return 0;
+
+	start = ktime_get_ns();
+	imx586_txn_init(imx586, &txn);
+
+	switch (ctrl->id) {
+	case V4L2_CID_EXPOSURE:
+		ret = imx586_set_exposure_cluster(imx586);
+		break;
+	case IMX586_CID_HDR_TH_HIGH:
+	case IMX586_CID_HDR_TH_LOW:
+		/* Only Clear HDR combines on the sensor */
+		if (!imx586->mode->hdr)
+			break;
+		imx586_txn_hold(&txn, true);
+		imx586_ctrl_write(imx586, &txn, ctrl->id == IMX586_CID_HDR_TH_HIGH ?
+				  IMX586_ASYNC_EXP_TH_H : IMX586_ASYNC_EXP_TH_L,
+				  ctrl->val);
+		imx586_txn_hold(&txn, false);
+		ret = imx586_ctrl_commit(imx586, &txn);
+		break;
+	case IMX586_CID_GC_KNEES:
+		/* Only the non-linear mode compresses */
+		if (imx586->mode->linear)
+			break;
+		imx586_txn_hold(&txn, true);
+		for (i = 0; i < IMX586_NUM_GC_KNEES; i++)
+			imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_CCMP1 + i,
+					  ctrl->p_new.p_u32[i]);
+		imx586_txn_hold(&txn, false);
+		ret = imx586_ctrl_commit(imx586, &txn);
+		break;
+	case V4L2_CID_HBLANK:
+		trace_imx586_set_hblank(client, ctrl->val, imx586->HMAX);
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_HMAX, imx586->HMAX);
+		ret = imx586_ctrl_commit(imx586, &txn);
+		break;
+	case V4L2_CID_VFLIP:
+		/* Clustered with HFLIP, both change on the same frame */
+		imx586_txn_hold(&txn, true);
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_HFLIP,
+				  imx586->hflip->val);
+		imx586_ctrl_write(imx586, &txn, IMX586_ASYNC_VFLIP,
+				  imx586->vflip->val);
+		imx586_txn_hold(&txn, false);
+		ret = imx586_ctrl_commit(imx586, &txn);
+		break;
+	default:
+		dev_info(&client->dev,
+			 "ctrl(id:0x%x,val:0x%x) is not handled\n",
+			 ctrl->id, ctrl->val);
+		//ret = -EINVAL;
+		break;
+	}
+
+	if (!ret)
+		imx586_stats_ctrl(imx586, ctrl->id, start);
+
+	pm_runtime_put(&client->dev);
+
+	return ret;
+}
+
+/*
+ * Locked means frame starts keep arriving, and the last two frame
+ * intervals agree to within 1/256. A follower that has lost its leader
+ * stops seeing XVS, and one still pulling in shows a drifting interval.
+ */
+static enum imx586_sync_status imx586_sync_status(struct imx586 *imx586)
+{
+	u64 last = READ_ONCE(imx586->xvs_last_ns);
+	u64 interval = READ_ONCE(imx586->xvs_interval_ns);
+	u64 prev = READ_ONCE(imx586->xvs_prev_interval_ns);
+	u64 diff;
+
+	if (!imx586->xvs_irq || !imx586->streaming)
+		return IMX586_SYNC_STATUS_UNKNOWN;
+
+	if (!interval || !prev || ktime_get_ns() - last > 2 * interval)
+		return IMX586_SYNC_STATUS_NO_SIGNAL;
+
+	diff = interval > prev ? interval - prev : prev - interval;
+	if (diff > interval >> 8)
+		return IMX586_SYNC_STATUS_UNSTABLE;
+
+	return IMX586_SYNC_STATUS_LOCKED;
+}
+
+/*
+ * Report the settings the sensor latched at the last frame start, in the
+ * units of the matching controls. Without the XVS interrupt there is no
+ * frame boundary to go by, so the last values sent are reported with a
+ * sequence of 0.
+ */
+static void imx586_frame_state(struct imx586 *imx586, u32 *state)
+{
+	u32 regs[IMX586_ASYNC_NUM];
+	unsigned long flags;
+	u32 seq;
+
+	spin_lock_irqsave(&imx586->state_lock, flags);
+	if (imx586->xvs_irq) {
+		memcpy(regs, imx586->state_live, sizeof(regs));
+		seq = imx586->live_seq;
+	} else {
+		memcpy(regs, imx586->state_sent, sizeof(regs));
+		seq = 0;
+	}
+	spin_unlock_irqrestore(&imx586->state_lock, flags);
+
+	if (imx586->mode->dol)
+		regs[IMX586_ASYNC_VMAX] *= 2;
+
+	state[0] = seq;
+	state[1] = regs[IMX586_ASYNC_VMAX] - regs[IMX586_ASYNC_SHR] +
+		   imx586->shr_offset_lines;
+	state[2] = regs[IMX586_ASYNC_GAIN];
+	if (regs[IMX586_ASYNC_FDG_SEL0])
+		state[2] += IMX586_ANA_GAIN_HCG_LEVEL;
+	state[3] = regs[IMX586_ASYNC_VMAX];
+	state[4] = regs[IMX586_ASYNC_HMAX];
+}
+
+static int imx586_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct imx586 *imx586 = container_of(ctrl->handler, struct imx586, ctrl_handler);
+
+	switch (ctrl->id) {
+	case IMX586_CID_SYNC_STATUS:
+		ctrl->val = imx586_sync_status(imx586);
+		return 0;
+	case IMX586_CID_FRAME_STATE:
+		imx586_frame_state(imx586, ctrl->p_new.p_u32);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Knees have to rise, and each ratio has its own range */
+static int imx586_try_ctrl(struct v4l2_ctrl *ctrl)
+{
+	const u32 *knee;
+
+	switch (ctrl->id) {
+	case IMX586_CID_GC_KNEES:
+		knee = ctrl->p_new.p_u32;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+		/* The advertised default is all zeros here, so take it as the curve */
+		if (!memchr_inv(knee, 0, IMX586_NUM_GC_KNEES * sizeof(*knee)))
+			memcpy(ctrl->p_new.p_u32, imx586_gc_knees_default,
+			       sizeof(imx586_gc_knees_default));
+#endif
+		if (knee[IMX586_GC_CCMP1] >= knee[IMX586_GC_CCMP2] ||
+		    knee[IMX586_GC_CCMP2] > IMX586_CCMP_MAX ||
+		    knee[IMX586_GC_ACMP1] > IMX586_ACMP_MAX ||
+		    knee[IMX586_GC_ACMP2] > IMX586_ACMP_MAX)
+			return -EINVAL;
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+static const struct v4l2_ctrl_ops imx586_ctrl_ops = {
+	.g_volatile_ctrl = imx586_g_volatile_ctrl,
+	.try_ctrl = imx586_try_ctrl,
+	.s_ctrl = imx586_set_ctrl,
+};
+
+static int imx586_enum_mbus_code(struct v4l2_subdev *sd,
+				 struct v4l2_subdev_state *sd_state,
+				 struct v4l2_subdev_mbus_code_enum *code)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+
+	if (code->pad >= NUM_PADS)
+		return -EINVAL;
+
+	if (code->pad == IMAGE_PAD) {
+        if(imx586->mono){
+            if (code->index >= (ARRAY_SIZE(mono_codes)))
+                return -EINVAL;
 
             code->code = imx586_get_format_code(imx586,
                                 mono_codes[code->index]);
@@ -1244,156 +2948,607 @@ static int imx586_enum_mbus_code(struct v4l2_subdev *sd,
 		if (code->index > 0)
 			return -EINVAL;
 
-		code->code = MEDIA_BUS_FMT_SENSOR_DATA;
+		code->code = MEDIA_BUS_FMT_SENSOR_DATA;
+	}
+
+	return 0;
+}
+
+static int imx586_enum_frame_size(struct v4l2_subdev *sd,
+				  struct v4l2_subdev_state *sd_state,
+				  struct v4l2_subdev_frame_size_enum *fse)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+
+	if (fse->pad >= NUM_PADS)
+		return -EINVAL;
+
+	if (fse->pad == IMAGE_PAD) {
+		const struct imx586_mode *mode_list;
+		unsigned int num_modes;
+
+		get_mode_table(imx586, fse->code, V4L2_XFER_FUNC_DEFAULT, &mode_list, &num_modes);
+
+		if (fse->index >= num_modes)
+			return -EINVAL;
+
+		if (fse->code != imx586_get_format_code(imx586, fse->code))
+			return -EINVAL;
+
+		fse->min_width = mode_list[fse->index].width;
+		fse->max_width = fse->min_width;
+		fse->min_height = mode_list[fse->index].height;
+		fse->max_height = fse->min_height;
+	} else {
+		if (fse->code != MEDIA_BUS_FMT_SENSOR_DATA || fse->index > 0)
+			return -EINVAL;
+
+		fse->min_width = IMX586_EMBEDDED_LINE_WIDTH;
+		fse->max_width = fse->min_width;
+		fse->min_height = IMX586_NUM_EMBEDDED_LINES;
+		fse->max_height = fse->min_height;
+	}
+
+	return 0;
+}
+
+static void imx586_reset_colorspace(const struct imx586_mode *mode, struct v4l2_mbus_framefmt *fmt)
+{
+	fmt->colorspace = V4L2_COLORSPACE_RAW;
+	fmt->ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(fmt->colorspace);
+	fmt->quantization = V4L2_MAP_QUANTIZATION_DEFAULT(true,
+							  fmt->colorspace,
+							  fmt->ycbcr_enc);
+	if (mode->dol)
+		fmt->xfer_func = V4L2_XFER_FUNC_DOL_HDR;
+	else
+		fmt->xfer_func = mode->linear ? V4L2_MAP_XFER_FUNC_DEFAULT(fmt->colorspace) : V4L2_XFER_FUNC_GRADATION_COMPRESSION;
+}
+
+static void imx586_update_image_pad_format(struct imx586 *imx586,
+					   const struct imx586_mode *mode,
+					   struct v4l2_subdev_format *fmt)
+{
+	fmt->format.width = mode->width;
+	fmt->format.height = mode->height;
+	fmt->format.field = V4L2_FIELD_NONE;
+	imx586_reset_colorspace(mode, &fmt->format);
+}
+
+static void imx586_update_metadata_pad_format(struct v4l2_subdev_format *fmt)
+{
+	fmt->format.width = IMX586_EMBEDDED_LINE_WIDTH;
+	fmt->format.height = IMX586_NUM_EMBEDDED_LINES;
+	fmt->format.code = MEDIA_BUS_FMT_SENSOR_DATA;
+	fmt->format.field = V4L2_FIELD_NONE;
+}
+
+static int imx586_get_pad_format(struct v4l2_subdev *sd,
+				 struct v4l2_subdev_state *sd_state,
+				 struct v4l2_subdev_format *fmt)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+
+	dev_dbg(&client->dev, "xfer_func: %d\n", (int)fmt->format.xfer_func);
+
+	if (fmt->pad >= NUM_PADS)
+		return -EINVAL;
+
+	if (fmt->which == V4L2_SUBDEV_FORMAT_TRY) {
+		struct v4l2_mbus_framefmt *try_fmt;
+
+		mutex_lock(&imx586->mutex);
+		try_fmt = v4l2_subdev_get_try_format(&imx586->sd, sd_state,
+						     fmt->pad);
+		/* Any Bayer order is reported as the depth's RGGB code */
+		try_fmt->code = fmt->pad == IMAGE_PAD ?
+				imx586_get_format_code(imx586, try_fmt->code) :
+				MEDIA_BUS_FMT_SENSOR_DATA;
+		fmt->format = *try_fmt;
+		mutex_unlock(&imx586->mutex);
+	} else if (fmt->pad == IMAGE_PAD) {
+		struct imx586_active_fmt active;
+
+		imx586_read_active(imx586, &active);
+		imx586_update_image_pad_format(imx586, active.mode, fmt);
+		fmt->format.width = active.width;
+		fmt->format.height = active.height;
+		fmt->format.code = imx586_get_format_code(imx586, active.code);
+	} else {
+		imx586_update_metadata_pad_format(fmt);
+	}
+
+	return 0;
+}
+
+/* Data rate and lane count, overriding the common table defaults */
+static int imx586_write_link(struct imx586 *imx586)
+{
+	struct imx586_txn txn;
+
+	imx586_txn_init(imx586, &txn);
+	imx586_txn_write(&txn, IMX586_REG_DATARATE_SEL, imx586->link_freq_idx, 1);
+	imx586_txn_write(&txn, IMX586_REG_LANEMODE,
+			 imx586->lanes == 2 ? IMX586_LANEMODE_2LANE :
+					      IMX586_LANEMODE_4LANE, 1);
+
+	return imx586_txn_commit(&txn);
+}
+
+/* Program window cropping, offsets relative to the pixel array origin */
+static int imx586_write_window(struct imx586 *imx586)
+{
+	const struct v4l2_rect *r = &imx586->crop;
+	struct imx586_txn txn;
+
+	imx586_txn_init(imx586, &txn);
+
+	if (imx586_crop_is_full(r)) {
+		imx586_txn_write(&txn, IMX586_REG_WINMODE,
+				 IMX586_WINMODE_ALL_PIXEL, 1);
+		return imx586_txn_commit(&txn);
+	}
+
+	imx586_txn_write(&txn, IMX586_REG_WINMODE, IMX586_WINMODE_CROP, 1);
+	imx586_txn_write(&txn, IMX586_REG_PIX_HST,
+			 r->left - IMX586_PIXEL_ARRAY_LEFT, 2);
+	imx586_txn_write(&txn, IMX586_REG_PIX_HWIDTH, r->width, 2);
+	imx586_txn_write(&txn, IMX586_REG_PIX_VST,
+			 r->top - IMX586_PIXEL_ARRAY_TOP, 2);
+	imx586_txn_write(&txn, IMX586_REG_PIX_VWIDTH, r->height, 2);
+
+	return imx586_txn_commit(&txn);
+}
+
+/*
+ * The shortest line is whichever is longer: the mode's own min_HMAX or
+ * the time the link needs to carry a line. Only a slower link than the
+ * tables assume pays for the divisions here.
+ */
+static void imx586_update_line_timing(struct imx586 *imx586)
+{
+	const struct imx586_mode *mode = imx586->mode;
+	u64 lane_bps = 2 * imx586_link_freqs[imx586->link_freq_idx];
+	u64 bits, link_bps;
+	u64 link_hmax;
+	u32 def;
+
+	bits = (u64)mode->width * mode->bpp * IMX586_PIXEL_RATE *
+	       IMX586_LINK_OVERHEAD_NUM;
+	link_bps = imx586->lanes * lane_bps * IMX586_LINK_OVERHEAD_DEN;
+	link_hmax = div64_u64(bits + link_bps - 1, link_bps);
+
+	/* Clear HDR modes spend two HMAX periods on every output line */
+	if (mode->hdr)
+		link_hmax = DIV_ROUND_UP(link_hmax, 2);
+
+	if (link_hmax <= mode->min_HMAX) {
+		imx586->line.min_HMAX = mode->min_HMAX;
+		imx586->line.default_HMAX = mode->default_HMAX;
+		imx586->line.pixel_rate = mode->pixel_rate;
+		imx586->line.hmax_recip = mode->hmax_recip;
+		imx586->line.default_hblank = mode->default_hblank;
+		return;
+	}
+
+	def = max_t(u32, mode->default_HMAX, link_hmax);
+	imx586->line.min_HMAX = link_hmax;
+	imx586->line.default_HMAX = def;
+	imx586->line.pixel_rate = div_u64((u64)mode->width * IMX586_PIXEL_RATE,
+					  link_hmax);
+	imx586->line.hmax_recip = div64_u64((u64)IMX586_PIXEL_RATE << 32,
+					    imx586->line.pixel_rate);
+	imx586->line.default_hblank =
+		DIV_ROUND_UP_ULL((u64)def * imx586->line.pixel_rate,
+				 IMX586_PIXEL_RATE) - mode->width;
+}
+
+/* TODO */
+static void imx586_set_framing_limits(struct imx586 *imx586)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	const struct imx586_mode *mode = imx586->mode;
+	u64 pixel_rate;
+	/*
+	 * A window keeps the mode's line length, so HBLANK makes up for the
+	 * narrower line, and every line not read out shortens the frame.
+	 */
+	u32 hblank_min = mode->width - imx586->width;
+	u64 def_hblank;
+	u32 skipped = mode->crop.height - imx586->crop.height;
+	u32 min_VMAX = mode->min_VMAX - skipped;
+	u32 default_VMAX = mode->default_VMAX - skipped;
+	u32 height = imx586->height;
+
+
+	imx586_update_line_timing(imx586);
+	pixel_rate = imx586->line.pixel_rate;
+	def_hblank = imx586->line.default_hblank + hblank_min;
+
+	imx586->VMAX = default_VMAX;
+	imx586_update_hmax(imx586, imx586->line.default_HMAX);
+
+	dev_info(&client->dev,"Pixel Rate : %lld\n",pixel_rate);
+
+
+	__v4l2_ctrl_modify_range(imx586->hblank, hblank_min,
+				 IMX586_HMAX_MAX, 1, def_hblank);
+
+
+	__v4l2_ctrl_s_ctrl(imx586->hblank, def_hblank);
+
+
+
+	/* Update limits and set FPS to default, FSC stays even in DOL */
+	__v4l2_ctrl_modify_range(imx586->vblank, min_VMAX - height,
+				 IMX586_VMAX_MAX - height,
+				 mode->dol ? 2 : 1, default_VMAX - height);
+	__v4l2_ctrl_s_ctrl(imx586->vblank, default_VMAX - height);
+
+	/* VBLANK may not have changed, so the notify is not enough here */
+	imx586_update_exposure_range(imx586);
+
+	__v4l2_ctrl_modify_range(imx586->pixel_rate, pixel_rate, pixel_rate, 1, pixel_rate);
+
+	v4l2_ctrl_activate(imx586->short_exposure, mode->dol);
+	v4l2_ctrl_activate(imx586->short_gain, mode->dol);
+	v4l2_ctrl_activate(imx586->hdr_th_high, mode->hdr);
+	v4l2_ctrl_activate(imx586->hdr_th_low, mode->hdr);
+	v4l2_ctrl_activate(imx586->gc_knees, !mode->linear);
+
+	dev_info(&client->dev,"Setting default HBLANK : %lld, VBLANK : %d with PixelRate: %lld\n",def_hblank,default_VMAX - height, pixel_rate);
+}
+
+/*
+ * Program the XVS/XHS pins for the sync mode. A leader drives both
+ * pulses, a follower leaves the pins as inputs with master operation
+ * stopped. Without sync, XVS is still driven if it is wired back to us.
+ */
+static int imx586_write_sync_mode(struct imx586 *imx586)
+{
+	struct imx586_txn txn;
+	u8 outsel = 0, drv = 0, xmsta = 0x00;
+
+	switch (imx586->sync_mode) {
+	case IMX586_SYNC_LEADER:
+		outsel = IMX586_XXS_OUTSEL_XVS | IMX586_XXS_OUTSEL_XHS;
+		drv = IMX586_XXS_DRV_XVS | IMX586_XXS_DRV_XHS;
+		break;
+	case IMX586_SYNC_FOLLOWER:
+		xmsta = 0x01;
+		break;
+	case IMX586_SYNC_OFF:
+		if (imx586->xvs_irq) {
+			outsel = IMX586_XXS_OUTSEL_XVS;
+			drv = IMX586_XXS_DRV_XVS;
+		}
+		break;
+	}
+
+	imx586_txn_init(imx586, &txn);
+	imx586_txn_write(&txn, IMX586_REG_XXS_OUTSEL, outsel, 1);
+	imx586_txn_write(&txn, IMX586_REG_XXS_DRV, drv, 1);
+	imx586_txn_write(&txn, IMX586_REG_XMSTA, xmsta, 1);
+
+	return imx586_txn_commit(&txn);
+}
+
+/* Write the mode dependent compression, HDR and clamp settings */
+static int imx586_write_hdr_settings(struct imx586 *imx586)
+{
+	struct imx586_txn txn;
+
+	imx586_txn_init(imx586, &txn);
+
+	/* Apply gradation compression curve for non-linear mode */
+	if ( !imx586->mode->linear ) {
+		const u32 *knee = imx586->gc_knees->p_cur.p_u32;
+
+		imx586_txn_write(&txn, IMX586_REG_CCMP1_EXP,
+				 knee[IMX586_GC_CCMP1], 3);
+		imx586_txn_write(&txn, IMX586_REG_ACMP1_EXP,
+				 knee[IMX586_GC_ACMP1], 1);
+		imx586_txn_write(&txn, IMX586_REG_CCMP2_EXP,
+				 knee[IMX586_GC_CCMP2], 3);
+		imx586_txn_write(&txn, IMX586_REG_ACMP2_EXP,
+				 knee[IMX586_GC_ACMP2], 1);
+	} else {
+		imx586_txn_write(&txn, IMX586_REG_CCMP1_EXP, 0, 3);
+		imx586_txn_write(&txn, IMX586_REG_ACMP1_EXP, 0, 1);
+		imx586_txn_write(&txn, IMX586_REG_CCMP2_EXP, 0, 3);
+		imx586_txn_write(&txn, IMX586_REG_ACMP2_EXP, 0, 1);
+	}
+	
+	/* Apply HDR combining options */
+	if ( imx586->mode->hdr ) {
+		imx586_txn_write(&txn, IMX586_REG_EXP_TH_H,
+				 imx586->hdr_th_high->val, 2);
+		imx586_txn_write(&txn, IMX586_REG_EXP_TH_L,
+				 imx586->hdr_th_low->val, 2);
+		imx586_txn_write(&txn, IMX586_REG_EXP_BK, 0, 1);
+	}
+	
+	/* Disable digital clamp */
+	imx586_txn_write(&txn, IMX586_REG_DIGITAL_CLAMP, 0, 1);
+
+	return imx586_txn_commit(&txn);
+}
+
+/*
+ * Walk the firmware payload. With @fill false the payload is only
+ * validated and its mode sections counted, otherwise each section is
+ * pointed at its bursts, which are written out as they are.
+ */
+static int imx586_fw_walk(struct imx586 *imx586, const u8 *p, size_t size,
+			  unsigned int num_sections, bool fill,
+			  unsigned int *num_modes)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct device *dev = &client->dev;
+	const u8 *end = p + size;
+	unsigned int n, modes = 0;
+
+	for (n = 0; n < num_sections; n++) {
+		const struct imx586_mode_table *table = NULL;
+		unsigned int id, count, filled = 0;
+		const u8 *sec;
+
+		if (end - p < 4)
+			goto truncated;
+		id = get_unaligned_le16(p);
+		count = get_unaligned_le16(p + 2);
+		p += 4;
+
+		if (id != IMX586_FW_SECTION_COMMON) {
+			unsigned int depth = IMX586_FW_SECTION_DEPTH(id);
+			unsigned int xfer = IMX586_FW_SECTION_XFER(id);
+
+			if ((id & 0xf000) != IMX586_FW_SECTION_MODE ||
+			    depth >= IMX586_NUM_DEPTHS ||
+			    xfer >= IMX586_NUM_XFER_CLASSES)
+				goto bad_section;
+			table = &imx586_mode_registry[depth][xfer];
+			if (IMX586_FW_SECTION_INDEX(id) >= table->num_modes)
+				goto bad_section;
+		}
+
+		sec = p;
+		while (filled < count) {
+			unsigned int addr, len;
+
+			if (end - p < 3)
+				goto truncated;
+			addr = get_unaligned_le16(p);
+			len = p[2];
+			p += 3;
+
+			if (!len || len > count - filled ||
+			    addr + len - 1 > IMX586_REG_MAX || end - p < len) {
+				dev_err(dev, "%s: bad burst at 0x%04x\n",
+					IMX586_FW_NAME, addr);
+				return -EINVAL;
+			}
+
+			p += len;
+			filled += len;
+		}
+
+		if (fill && !table) {
+			imx586->fw_common.bursts = sec;
+			imx586->fw_common.num_of_regs = count;
+		} else if (fill) {
+			struct imx586_fw_mode *fw_mode = &imx586->fw_modes[modes];
+
+			fw_mode->mode = &table->modes[IMX586_FW_SECTION_INDEX(id)];
+			fw_mode->reg_list.bursts = sec;
+			fw_mode->reg_list.num_of_regs = count;
+		}
+		if (table)
+			modes++;
 	}
 
+	if (p != end)
+		goto truncated;
+
+	*num_modes = modes;
+
 	return 0;
+
+bad_section:
+	dev_err(dev, "%s: unknown section %u\n", IMX586_FW_NAME, n);
+	return -EINVAL;
+truncated:
+	dev_err(dev, "%s: truncated or trailing data\n", IMX586_FW_NAME);
+	return -EINVAL;
 }
 
-static int imx586_enum_frame_size(struct v4l2_subdev *sd,
-				  struct v4l2_subdev_state *sd_state,
-				  struct v4l2_subdev_frame_size_enum *fse)
+static int imx586_fw_parse(struct imx586 *imx586, const u8 *data, size_t size)
 {
-	struct imx586 *imx586 = to_imx586(sd);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct device *dev = &client->dev;
+	unsigned int num_sections, num_modes;
+	size_t payload;
+	int ret;
 
-	if (fse->pad >= NUM_PADS)
+	if (size < IMX586_FW_HEADER_SIZE ||
+	    get_unaligned_le32(data) != IMX586_FW_MAGIC ||
+	    get_unaligned_le16(data + 4) != IMX586_FW_VERSION) {
+		dev_err(dev, "%s: bad header\n", IMX586_FW_NAME);
 		return -EINVAL;
+	}
 
-	if (fse->pad == IMAGE_PAD) {
-		const struct imx586_mode *mode_list;
-		unsigned int num_modes;
-
-		get_mode_table(imx586, fse->code, V4L2_XFER_FUNC_DEFAULT, &mode_list, &num_modes);
+	num_sections = get_unaligned_le16(data + 6);
+	payload = get_unaligned_le32(data + 8);
+	if (payload != size - IMX586_FW_HEADER_SIZE) {
+		dev_err(dev, "%s: size mismatch\n", IMX586_FW_NAME);
+		return -EINVAL;
+	}
 
-		if (fse->index >= num_modes)
-			return -EINVAL;
+	data += IMX586_FW_HEADER_SIZE;
+	if ((crc32_le(~0, data, payload) ^ ~0) !=
+	    get_unaligned_le32(data - IMX586_FW_HEADER_SIZE + 12)) {
+		dev_err(dev, "%s: checksum mismatch\n", IMX586_FW_NAME);
+		return -EINVAL;
+	}
 
-		if (fse->code != imx586_get_format_code(imx586, fse->code))
-			return -EINVAL;
+	ret = imx586_fw_walk(imx586, data, payload, num_sections, false,
+			     &num_modes);
+	if (ret)
+		return ret;
 
-		fse->min_width = mode_list[fse->index].width;
-		fse->max_width = fse->min_width;
-		fse->min_height = mode_list[fse->index].height;
-		fse->max_height = fse->min_height;
-	} else {
-		if (fse->code != MEDIA_BUS_FMT_SENSOR_DATA || fse->index > 0)
-			return -EINVAL;
+	/* The bursts are kept as they are, so the payload outlives @data */
+	data = devm_kmemdup(dev, data, payload, GFP_KERNEL);
+	imx586->fw_modes = devm_kcalloc(dev, num_modes,
+					sizeof(*imx586->fw_modes), GFP_KERNEL);
+	if (!data || (num_modes && !imx586->fw_modes))
+		return -ENOMEM;
 
-		fse->min_width = IMX586_EMBEDDED_LINE_WIDTH;
-		fse->max_width = fse->min_width;
-		fse->min_height = IMX586_NUM_EMBEDDED_LINES;
-		fse->max_height = fse->min_height;
-	}
+	imx586->fw_num_modes = num_modes;
 
-	return 0;
+	return imx586_fw_walk(imx586, data, payload, num_sections, true,
+			      &num_modes);
 }
 
-static void imx586_reset_colorspace(const struct imx586_mode *mode, struct v4l2_mbus_framefmt *fmt)
+/*
+ * Register sequence firmware requested at probe. Without it, or if it
+ * fails to validate, the built-in tables stay in use.
+ */
+static void imx586_fw_loaded(const struct firmware *fw, void *context)
 {
-	fmt->colorspace = V4L2_COLORSPACE_RAW;
-	fmt->ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(fmt->colorspace);
-	fmt->quantization = V4L2_MAP_QUANTIZATION_DEFAULT(true,
-							  fmt->colorspace,
-							  fmt->ycbcr_enc);
-	fmt->xfer_func = mode->linear ? V4L2_MAP_XFER_FUNC_DEFAULT(fmt->colorspace) : V4L2_XFER_FUNC_GRADATION_COMPRESSION;
+	struct imx586 *imx586 = context;
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct device *dev = &client->dev;
+	int ret;
+
+	if (!fw)
+		goto done;
+
+	mutex_lock(&imx586->mutex);
+
+	ret = imx586_fw_parse(imx586, fw->data, fw->size);
+	if (ret) {
+		memset(&imx586->fw_common, 0, sizeof(imx586->fw_common));
+		imx586->fw_modes = NULL;
+		imx586->fw_num_modes = 0;
+		dev_warn(dev, "%s rejected, using built-in register tables\n",
+			 IMX586_FW_NAME);
+	} else {
+		/* A stream on before the file arrived used the built-in tables */
+		imx586->common_regs_written = false;
+		dev_info(dev, "using register sequences from %s (%u modes)\n",
+			 IMX586_FW_NAME, imx586->fw_num_modes);
+	}
+
+	mutex_unlock(&imx586->mutex);
+	release_firmware(fw);
+done:
+	complete(&imx586->fw_done);
 }
 
-static void imx586_update_image_pad_format(struct imx586 *imx586,
-					   const struct imx586_mode *mode,
-					   struct v4l2_subdev_format *fmt)
+static const struct IMX586_reg_list *
+imx586_common_regs(struct imx586 *imx586)
 {
-	fmt->format.width = mode->width;
-	fmt->format.height = mode->height;
-	fmt->format.field = V4L2_FIELD_NONE;
-	imx586_reset_colorspace(mode, &fmt->format);
+	static const struct IMX586_reg_list builtin = {
+		.num_of_regs = ARRAY_SIZE(mode_common_regs),
+		.regs = mode_common_regs,
+	};
+
+	return imx586->fw_common.bursts ? &imx586->fw_common : &builtin;
 }
 
-static void imx586_update_metadata_pad_format(struct v4l2_subdev_format *fmt)
+static const struct IMX586_reg_list *
+imx586_mode_regs(struct imx586 *imx586, const struct imx586_mode *mode)
 {
-	fmt->format.width = IMX586_EMBEDDED_LINE_WIDTH;
-	fmt->format.height = IMX586_NUM_EMBEDDED_LINES;
-	fmt->format.code = MEDIA_BUS_FMT_SENSOR_DATA;
-	fmt->format.field = V4L2_FIELD_NONE;
+	unsigned int i;
+
+	for (i = 0; i < imx586->fw_num_modes; i++)
+		if (imx586->fw_modes[i].mode == mode)
+			return &imx586->fw_modes[i].reg_list;
+
+	return &mode->reg_list;
 }
 
-static int imx586_get_pad_format(struct v4l2_subdev *sd,
-				 struct v4l2_subdev_state *sd_state,
-				 struct v4l2_subdev_format *fmt)
+/*
+ * A mode switch failed part way: the sensor may hold a mix of both modes,
+ * so stop the stream as stream off would. The next stream on uploads the
+ * current mode in full.
+ */
+static void imx586_switch_mode_abort(struct imx586 *imx586, int err)
 {
-	struct imx586 *imx586 = to_imx586(sd);
 	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
 
-	dev_info(&client->dev,"xfer_func: %d\n", (int)fmt->format.xfer_func);
+	dev_err(&client->dev, "mode switch failed (%d), stopping stream\n",
+		err);
 
-	if (fmt->pad >= NUM_PADS)
-		return -EINVAL;
+	if (imx586->xvs_irq)
+		disable_irq(imx586->xvs_irq);
 
-	mutex_lock(&imx586->mutex);
+	trace_imx586_stream_off(client);
+	imx586_write_reg_1byte(imx586, IMX586_REG_MODE_SELECT,
+			       IMX586_MODE_STANDBY);
 
-	if (fmt->which == V4L2_SUBDEV_FORMAT_TRY) {
-		struct v4l2_mbus_framefmt *try_fmt =
-			v4l2_subdev_get_try_format(&imx586->sd, sd_state,
-						   fmt->pad);
-		/* update the code which could change due to vflip or hflip: */
-		try_fmt->code = fmt->pad == IMAGE_PAD ?
-				imx586_get_format_code(imx586, try_fmt->code) :
-				MEDIA_BUS_FMT_SENSOR_DATA;
-		fmt->format = *try_fmt;
-	} else {
-		if (fmt->pad == IMAGE_PAD) {
-			imx586_update_image_pad_format(imx586, imx586->mode,
-						       fmt);
-			fmt->format.code =
-			       imx586_get_format_code(imx586, imx586->fmt_code);
-		} else {
-			imx586_update_metadata_pad_format(fmt);
-		}
-	}
+	imx586->streaming = false;
+	__v4l2_ctrl_grab(imx586->sync_ctrl, false);
 
-	mutex_unlock(&imx586->mutex);
-	return 0;
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
 }
 
-/* TODO */
-static void imx586_set_framing_limits(struct imx586 *imx586)
+/*
+ * Switch modes while streaming. The sensor keeps its configuration in
+ * standby and the shadow knows what it holds, so only the registers that
+ * differ from the old mode are written before streaming resumes, without
+ * the full stream-on upload or its settle delay.
+ */
+static int imx586_switch_mode(struct imx586 *imx586,
+			      const struct imx586_mode *mode)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-	const struct imx586_mode *mode = imx586->mode;
-	u64 def_hblank;
-	u64 pixel_rate;
-
+	int ret;
 
-	imx586->VMAX = mode->default_VMAX;
-	imx586->HMAX = mode->default_HMAX;
+	/* The new mode's controls are written inline, before streaming */
+	imx586->async_active = false;
+	imx586_async_flush(imx586);
 
-	pixel_rate = (u64)mode->width * IMX586_PIXEL_RATE;
-	do_div(pixel_rate,mode->min_HMAX);
-	dev_info(&client->dev,"Pixel Rate : %lld\n",pixel_rate);
+	ret = imx586_write_reg_1byte(imx586, IMX586_REG_MODE_SELECT,
+				     IMX586_MODE_STANDBY);
+	if (ret)
+		goto err_abort;
 
+	ret = imx586_write_reg_list(imx586, imx586_mode_regs(imx586, mode));
+	if (ret)
+		goto err_abort;
 
-	//int def_hblank = mode->default_HMAX * IMX586_PIXEL_RATE / 72000000 - IMX586_NATIVE_WIDTH;
-	def_hblank = mode->default_HMAX * pixel_rate;
-	do_div(def_hblank,IMX586_PIXEL_RATE);
-	def_hblank = def_hblank - mode->width;
-	__v4l2_ctrl_modify_range(imx586->hblank, 0,
-				 IMX586_HMAX_MAX, 1, def_hblank);
+	imx586->mode = mode;
+	imx586_reset_window(imx586);
+	imx586_set_framing_limits(imx586);
+	imx586_publish_active(imx586);
 
+	ret = imx586_write_hdr_settings(imx586);
+	if (ret)
+		goto err_abort;
 
-	__v4l2_ctrl_s_ctrl(imx586->hblank, def_hblank);
+	ret = imx586_write_window(imx586);
+	if (ret)
+		goto err_abort;
 
+	ret = __v4l2_ctrl_handler_setup(imx586->sd.ctrl_handler);
+	if (ret)
+		goto err_abort;
 
+	ret = imx586_write_reg_1byte(imx586, IMX586_REG_MODE_SELECT,
+				     IMX586_MODE_STREAMING);
+	if (ret)
+		goto err_abort;
 
-	/* Update limits and set FPS to default */
-	__v4l2_ctrl_modify_range(imx586->vblank, mode->min_VMAX - mode->height,
-				 IMX586_VMAX_MAX - mode->height,
-				 1, mode->default_VMAX - mode->height);
-	__v4l2_ctrl_s_ctrl(imx586->vblank, mode->default_VMAX - mode->height);
+	imx586->async_active = !!imx586->ctrl_worker;
 
-	/* Setting this will adjust the exposure limits as well. */
+	return 0;
 
-	__v4l2_ctrl_modify_range(imx586->pixel_rate, pixel_rate, pixel_rate, 1, pixel_rate);
+err_abort:
+	imx586_switch_mode_abort(imx586, ret);
 
-	dev_info(&client->dev,"Setting default HBLANK : %lld, VBLANK : %lld with PixelRate: %lld\n",def_hblank,mode->default_VMAX - mode->height, pixel_rate);
+	return ret;
 }
 
 /* TODO */
@@ -1405,8 +3560,9 @@ static int imx586_set_pad_format(struct v4l2_subdev *sd,
 	const struct imx586_mode *mode;
 	struct imx586 *imx586 = to_imx586(sd);
 	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	int ret = 0;
 
-	dev_info(&client->dev,"xfer_func: %d\n", (int)fmt->format.xfer_func);
+	dev_dbg(&client->dev, "xfer_func: %d\n", (int)fmt->format.xfer_func);
 
 	if (fmt->pad >= NUM_PADS)
 		return -EINVAL;
@@ -1417,7 +3573,7 @@ static int imx586_set_pad_format(struct v4l2_subdev *sd,
 		const struct imx586_mode *mode_list;
 		unsigned int num_modes;
 
-		/* Bayer order varies with flips */
+		/* Flips keep RGGB, so only the depth of the code matters */
 		fmt->format.code = imx586_get_format_code(imx586,
 							  fmt->format.code);
 
@@ -1433,10 +3589,22 @@ static int imx586_set_pad_format(struct v4l2_subdev *sd,
 			framefmt = v4l2_subdev_get_try_format(sd, sd_state,
 							      fmt->pad);
 			*framefmt = fmt->format;
-		} else if (imx586->mode != mode) {
+		} else if (imx586->mode != mode && imx586->streaming) {
+			/* Only the frame size may change without a restart */
+			if (fmt->format.code != imx586->fmt_code)
+				ret = -EBUSY;
+			else
+				ret = imx586_switch_mode(imx586, mode);
+		} else if (imx586->streaming && imx586_window_active(imx586)) {
+			/* The window may not change while streaming either */
+			ret = -EBUSY;
+		} else if (imx586->mode != mode || imx586_window_active(imx586)) {
+			/* A new format starts from the mode's full frame */
 			imx586->mode = mode;
 			imx586->fmt_code = fmt->format.code;
+			imx586_reset_window(imx586);
 			imx586_set_framing_limits(imx586);
+			imx586_publish_active(imx586);
 		}
 	} else {
 		if (fmt->which == V4L2_SUBDEV_FORMAT_TRY) {
@@ -1451,7 +3619,7 @@ static int imx586_set_pad_format(struct v4l2_subdev *sd,
 
 	mutex_unlock(&imx586->mutex);
 
-	return 0;
+	return ret;
 }
 
 /* TODO */
@@ -1464,7 +3632,7 @@ __imx586_get_pad_crop(struct imx586 *imx586,
 	case V4L2_SUBDEV_FORMAT_TRY:
 		return v4l2_subdev_get_try_crop(&imx586->sd, sd_state, pad);
 	case V4L2_SUBDEV_FORMAT_ACTIVE:
-		return &imx586->mode->crop;
+		return &imx586->crop;
 	}
 
 	return NULL;
@@ -1475,63 +3643,105 @@ static int imx586_start_streaming(struct imx586 *imx586)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
 	const struct IMX586_reg_list *reg_list;
+	struct imx586_stats *st = &imx586->stats;
+	u64 xfers, bytes, start, t;
+	unsigned long flags;
 	int ret;
 	
 	dev_info(&client->dev,"imx586_start_streaming\n");
 
+	start = ktime_get_ns();
+	spin_lock_irqsave(&st->lock, flags);
+	xfers = st->i2c_xfers;
+	bytes = st->i2c_bytes;
+	spin_unlock_irqrestore(&st->lock, flags);
+
 	if (!imx586->common_regs_written) {
-		ret = imx586_write_regs(imx586, mode_common_regs, ARRAY_SIZE(mode_common_regs));
+		t = ktime_get_ns();
+		reg_list = imx586_common_regs(imx586);
+		ret = imx586_write_reg_list(imx586, reg_list);
 		if (ret) {
 			dev_err(&client->dev, "%s failed to set common settings\n", __func__);
 			return ret;
 		}
 		imx586_write_reg_2byte(imx586, IMX586_REG_BLKLEVEL, IMX586_BLKLEVEL_DEFAULT);
 		imx586->common_regs_written = true;
+		imx586_stats_add(imx586, IMX586_STAT_COMMON_REGS, t);
 		dev_info(&client->dev,"common_regs_written\n");
 	}
 
 	/* Apply default values of current mode */
-	reg_list = &imx586->mode->reg_list;
-	ret = imx586_write_regs(imx586, reg_list->regs, reg_list->num_of_regs);
+	t = ktime_get_ns();
+	reg_list = imx586_mode_regs(imx586, imx586->mode);
+	ret = imx586_write_reg_list(imx586, reg_list);
 	if (ret) {
 		dev_err(&client->dev, "%s failed to set mode\n", __func__);
 		return ret;
 	}
+	imx586_stats_add(imx586, IMX586_STAT_MODE_REGS, t);
 
-	/* Apply gradation compression curve for non-linear mode */
-	if ( !imx586->mode->linear ) {
-		imx586_write_reg_3byte(imx586, IMX586_REG_CCMP1_EXP, 500);
-		imx586_write_reg_1byte(imx586, IMX586_REG_ACMP1_EXP, 0x2);
-		imx586_write_reg_3byte(imx586, IMX586_REG_CCMP2_EXP, 11500);
-		imx586_write_reg_1byte(imx586, IMX586_REG_ACMP2_EXP, 0x6);
-	} else {
-		imx586_write_reg_3byte(imx586, IMX586_REG_CCMP1_EXP, 0);
-		imx586_write_reg_1byte(imx586, IMX586_REG_ACMP1_EXP, 0);
-		imx586_write_reg_3byte(imx586, IMX586_REG_CCMP2_EXP, 0);
-		imx586_write_reg_1byte(imx586, IMX586_REG_ACMP2_EXP, 0);
+	ret = imx586_write_hdr_settings(imx586);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to set HDR settings\n", __func__);
+		return ret;
 	}
-	
-	/* Apply HDR combining options */
-	if ( imx586->mode->hdr ) {
-		imx586_write_reg_2byte(imx586, IMX586_REG_EXP_TH_H, 4095);
-		imx586_write_reg_2byte(imx586, IMX586_REG_EXP_TH_L, 512);
-		imx586_write_reg_1byte(imx586, IMX586_REG_EXP_BK, 0);
+
+	ret = imx586_write_sync_mode(imx586);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to set sync mode\n", __func__);
+		return ret;
+	}
+
+	ret = imx586_write_window(imx586);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to set window\n", __func__);
+		return ret;
+	}
+
+	ret = imx586_write_link(imx586);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to set CSI-2 link\n", __func__);
+		return ret;
 	}
-	
-	/* Disable digital clamp */
-	imx586_write_reg_1byte(imx586, IMX586_REG_DIGITAL_CLAMP, 0);
 	
 	/* Apply customized values from user */
+	t = ktime_get_ns();
 	ret =  __v4l2_ctrl_handler_setup(imx586->sd.ctrl_handler);
 	if(ret) {
 		dev_err(&client->dev, "%s failed to apply user values\n", __func__);
 		return ret;
 	}
+	imx586_stats_add(imx586, IMX586_STAT_CTRL_SETUP, t);
 
 	/* Set stream on register */
+	trace_imx586_stream_on(client, imx586->width, imx586->height,
+			       imx586->VMAX, imx586->HMAX);
 	ret = imx586_write_reg_1byte(imx586, IMX586_REG_MODE_SELECT, IMX586_MODE_STREAMING);
-	usleep_range(IMX586_STREAM_DELAY_US, IMX586_STREAM_DELAY_US + IMX586_STREAM_DELAY_RANGE_US);
-	return ret;
+	if (imx586->stream_delay_us)
+		usleep_range(imx586->stream_delay_us,
+			     imx586->stream_delay_us + IMX586_STREAM_DELAY_RANGE_US);
+	if (ret)
+		return ret;
+
+	/* From here on control writes can go through the worker */
+	imx586->async_active = !!imx586->ctrl_worker;
+
+	if (imx586->xvs_irq) {
+		atomic_set(&imx586->frame_seq, 0);
+		imx586->live_seq = 0;
+		imx586->xvs_last_ns = 0;
+		imx586->xvs_interval_ns = 0;
+		imx586->xvs_prev_interval_ns = 0;
+		enable_irq(imx586->xvs_irq);
+	}
+
+	imx586_stats_add(imx586, IMX586_STAT_STREAM_ON, start);
+	spin_lock_irqsave(&st->lock, flags);
+	st->stream_on_xfers = st->i2c_xfers - xfers;
+	st->stream_on_bytes = st->i2c_bytes - bytes;
+	spin_unlock_irqrestore(&st->lock, flags);
+
+	return 0;
 }
 
 /* Stop streaming */
@@ -1542,7 +3752,15 @@ static void imx586_stop_streaming(struct imx586 *imx586)
 	
 	dev_info(&client->dev,"imx586_stop_streaming\n");
 
+	if (imx586->xvs_irq)
+		disable_irq(imx586->xvs_irq);
+
+	/* Let queued control writes land before the sensor stops */
+	imx586->async_active = false;
+	imx586_async_flush(imx586);
+
 	/* set stream off register */
+	trace_imx586_stream_off(client);
 	ret = imx586_write_reg_1byte(imx586, IMX586_REG_MODE_SELECT, IMX586_MODE_STANDBY);
 	if (ret)
 		dev_err(&client->dev, "%s failed to stop stream\n", __func__);
@@ -1576,13 +3794,13 @@ static int imx586_set_stream(struct v4l2_subdev *sd, int enable)
 			goto err_rpm_put;
 	} else {
 		imx586_stop_streaming(imx586);
-		pm_runtime_put(&client->dev);
+		pm_runtime_mark_last_busy(&client->dev);
+		pm_runtime_put_autosuspend(&client->dev);
 	}
 
 	imx586->streaming = enable;
 
-	/* vflip and hflip cannot change during streaming */
-	__v4l2_ctrl_grab(imx586->vflip, enable);
+	__v4l2_ctrl_grab(imx586->sync_ctrl, enable);
 
 	mutex_unlock(&imx586->mutex);
 
@@ -1596,6 +3814,64 @@ err_unlock:
 	return ret;
 }
 
+static int imx586_identify_module(struct imx586 *imx586, u32 expected_id)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	int ret;
+	u32 val;
+
+	ret = imx586_read_reg(imx586, IMX586_REG_CHIP_ID,
+			      1, &val);
+	if (ret) {
+		dev_err(&client->dev, "failed to read chip id %x, with error %d\n",
+			expected_id, ret);
+		return ret;
+	}
+
+	if (val != expected_id) {
+		dev_err(&client->dev, "chip id mismatch: %x!=%x\n",
+			expected_id, val);
+		return -ENODEV;
+	}
+
+	dev_info(&client->dev, "Device found, ID: %x\n", val);
+
+	return 0;
+}
+
+/*
+ * Poll until the sensor ACKs a read after XCLR, backing off up to
+ * IMX586_READY_POLL_MAX_US between reads. The value is left to identify,
+ * as the register is also written once streaming. A sensor that never
+ * answers has simply waited out the full timeout, and identify reports it.
+ */
+static void imx586_wait_ready(struct imx586 *imx586)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	unsigned int interval = IMX586_READY_POLL_MIN_US;
+	ktime_t start = ktime_get();
+	ktime_t timeout = ktime_add_us(start, imx586->ready_timeout_us);
+	u32 val;
+
+	for (;;) {
+		if (!imx586_read_reg(imx586, IMX586_REG_CHIP_ID, 1, &val)) {
+			dev_dbg(&client->dev, "sensor ready after %lld us\n",
+				ktime_us_delta(ktime_get(), start));
+			return;
+		}
+
+		if (ktime_after(ktime_get(), timeout))
+			break;
+
+		usleep_range(interval, interval + interval / 4);
+		interval = min_t(unsigned int, interval * 2,
+				 IMX586_READY_POLL_MAX_US);
+	}
+
+	dev_warn(&client->dev, "no answer after %u us\n",
+		 imx586->ready_timeout_us);
+}
+
 /* Power/clock management functions */
 static int imx586_power_on(struct device *dev)
 {
@@ -1604,6 +3880,18 @@ static int imx586_power_on(struct device *dev)
 	struct imx586 *imx586 = to_imx586(sd);
 	int ret;
 
+	/* Registers survived warm standby: no XCLR cycle, no reprogramming */
+	if (imx586->power_state == IMX586_POWER_WARM) {
+		ret = clk_prepare_enable(imx586->xclk);
+		if (ret) {
+			dev_err(&client->dev, "%s: failed to enable clock\n",
+				__func__);
+			return ret;
+		}
+		imx586->power_state = IMX586_POWER_ON;
+		return 0;
+	}
+
 	ret = regulator_bulk_enable(imx586_NUM_SUPPLIES,
 				    imx586->supplies);
 	if (ret) {
@@ -1620,28 +3908,74 @@ static int imx586_power_on(struct device *dev)
 	}
 
 	gpiod_set_value_cansleep(imx586->reset_gpio, 1);
-	usleep_range(imx586_XCLR_MIN_DELAY_US,
-		     imx586_XCLR_MIN_DELAY_US + imx586_XCLR_DELAY_RANGE_US);
+	if (imx586->xclr_delay_us)
+		usleep_range(imx586->xclr_delay_us,
+			     imx586->xclr_delay_us + imx586_XCLR_DELAY_RANGE_US);
+
+	imx586_wait_ready(imx586);
+
+	if (!imx586->identified) {
+		ret = imx586_identify_module(imx586,
+					     imx586->compatible_data->chip_id);
+		if (ret)
+			goto xclr_off;
+		imx586->identified = true;
+	}
+
+	imx586->power_state = IMX586_POWER_ON;
 
 	return 0;
 
+xclr_off:
+	gpiod_set_value_cansleep(imx586->reset_gpio, 0);
+	clk_disable_unprepare(imx586->xclk);
 reg_off:
 	regulator_bulk_disable(imx586_NUM_SUPPLIES, imx586->supplies);
 	return ret;
 }
 
-static int imx586_power_off(struct device *dev)
+/* Cut supplies and xclk from either the on or the warm standby state */
+static void imx586_power_off_full(struct imx586 *imx586)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct v4l2_subdev *sd = i2c_get_clientdata(client);
-	struct imx586 *imx586 = to_imx586(sd);
+	unsigned long flags;
+
+	if (imx586->power_state == IMX586_POWER_OFF)
+		return;
 
 	gpiod_set_value_cansleep(imx586->reset_gpio, 0);
 	regulator_bulk_disable(imx586_NUM_SUPPLIES, imx586->supplies);
-	clk_disable_unprepare(imx586->xclk);
+	if (imx586->power_state == IMX586_POWER_ON)
+		clk_disable_unprepare(imx586->xclk);
+	imx586->power_state = IMX586_POWER_OFF;
 
 	/* Force reprogramming of the common registers when powered up again. */
 	imx586->common_regs_written = false;
+	/* The sensor loses its registers; the shadow must not vouch for them */
+	imx586_reg_invalidate(imx586, IMX586_REG_BASE, IMX586_NUM_REGS);
+
+	/* Start over with full bursts, the bus may have been fixed meanwhile */
+	spin_lock_irqsave(&imx586->stats.lock, flags);
+	imx586->burst_limit = IMX586_MAX_BURST_LEN;
+	imx586->i2c_nacks = 0;
+	imx586->i2c_clean = 0;
+	spin_unlock_irqrestore(&imx586->stats.lock, flags);
+}
+
+static int imx586_power_off(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct v4l2_subdev *sd = i2c_get_clientdata(client);
+	struct imx586 *imx586 = to_imx586(sd);
+
+	/* The sensor is already in MODE_SELECT standby when streaming stops */
+	if ((imx586->warm_standby < 0 ? warm_standby : imx586->warm_standby) &&
+	    imx586->power_state == IMX586_POWER_ON) {
+		clk_disable_unprepare(imx586->xclk);
+		imx586->power_state = IMX586_POWER_WARM;
+		return 0;
+	}
+
+	imx586_power_off_full(imx586);
 
 	return 0;
 }
@@ -1652,9 +3986,19 @@ static int __maybe_unused imx586_suspend(struct device *dev)
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx586 *imx586 = to_imx586(sd);
 
+	int ret;
+
 	if (imx586->streaming)
 		imx586_stop_streaming(imx586);
 
+	/* Powers down a sensor that is streaming or still in autosuspend */
+	ret = pm_runtime_force_suspend(dev);
+	if (ret)
+		return ret;
+
+	/* Warm standby is for runtime PM, do not hold the supplies up in sleep */
+	imx586_power_off_full(imx586);
+
 	return 0;
 }
 
@@ -1665,6 +4009,11 @@ static int __maybe_unused imx586_resume(struct device *dev)
 	struct imx586 *imx586 = to_imx586(sd);
 	int ret;
 
+	/* Only powers up again if streaming held a runtime PM reference */
+	ret = pm_runtime_force_resume(dev);
+	if (ret)
+		return ret;
+
 	if (imx586->streaming) {
 		ret = imx586_start_streaming(imx586);
 		if (ret)
@@ -1693,25 +4042,6 @@ static int imx586_get_regulators(struct imx586 *imx586)
 }
 
 /* Verify chip ID */
-static int imx586_identify_module(struct imx586 *imx586, u32 expected_id)
-{
-	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
-	int ret;
-	u32 val;
-
-	ret = imx586_read_reg(imx586, IMX586_REG_CHIP_ID,
-			      1, &val);
-	if (ret) {
-		dev_err(&client->dev, "failed to read chip id %x, with error %d\n",
-			expected_id, ret);
-		return ret;
-	}
-
-	dev_info(&client->dev, "Device found, ID: %x\n", val);
-
-	return 0;
-}
-
 static int imx586_get_selection(struct v4l2_subdev *sd,
 				struct v4l2_subdev_state *sd_state,
 				struct v4l2_subdev_selection *sel)
@@ -1719,6 +4049,13 @@ static int imx586_get_selection(struct v4l2_subdev *sd,
 	switch (sel->target) {
 	case V4L2_SEL_TGT_CROP: {
 		struct imx586 *imx586 = to_imx586(sd);
+		struct imx586_active_fmt active;
+
+		if (sel->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+			imx586_read_active(imx586, &active);
+			sel->r = active.crop;
+			return 0;
+		}
 
 		mutex_lock(&imx586->mutex);
 		sel->r = *__imx586_get_pad_crop(imx586, sd_state, sel->pad,
@@ -1749,9 +4086,61 @@ static int imx586_get_selection(struct v4l2_subdev *sd,
 	return -EINVAL;
 }
 
+static int imx586_set_selection(struct v4l2_subdev *sd,
+				struct v4l2_subdev_state *sd_state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+	int ret = 0;
+
+	if (sel->target != V4L2_SEL_TGT_CROP || sel->pad != IMAGE_PAD)
+		return -EINVAL;
+
+	mutex_lock(&imx586->mutex);
+
+	imx586_adjust_crop(&sel->r);
+
+	if (sel->which == V4L2_SUBDEV_FORMAT_TRY) {
+		*v4l2_subdev_get_try_crop(sd, sd_state, sel->pad) = sel->r;
+	} else if (imx586->streaming) {
+		ret = -EBUSY;
+	} else if (!imx586_mode_can_window(imx586->mode)) {
+		/* Binned modes always read the full array */
+		sel->r = imx586->mode->crop;
+	} else {
+		imx586->crop = sel->r;
+		if (imx586_window_active(imx586)) {
+			imx586->width = sel->r.width;
+			imx586->height = sel->r.height;
+		} else {
+			imx586_reset_window(imx586);
+		}
+		imx586_set_framing_limits(imx586);
+		imx586_publish_active(imx586);
+	}
+
+	mutex_unlock(&imx586->mutex);
+
+	return ret;
+}
+
+
+static int imx586_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				  struct v4l2_event_subscription *sub)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+
+	if (sub->type == V4L2_EVENT_FRAME_SYNC) {
+		if (!imx586->xvs_irq)
+			return -EINVAL;
+		return v4l2_event_subscribe(fh, sub, 2, NULL);
+	}
+
+	return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+}
 
 static const struct v4l2_subdev_core_ops imx586_core_ops = {
-	.subscribe_event = v4l2_ctrl_subdev_subscribe_event,
+	.subscribe_event = imx586_subscribe_event,
 	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
@@ -1759,12 +4148,57 @@ static const struct v4l2_subdev_video_ops imx586_video_ops = {
 	.s_stream = imx586_set_stream,
 };
 
+static u8 imx586_csi2_dt(const struct imx586_mode *mode)
+{
+	switch (mode->bpp) {
+	case 10:
+		return MIPI_CSI2_DT_RAW10;
+	case 16:
+		return MIPI_CSI2_DT_RAW16;
+	default:
+		return MIPI_CSI2_DT_RAW12;
+	}
+}
+
+/*
+ * DOL modes send the long frame on VC0 and the short one on VC1. There is
+ * no embedded data stream to describe.
+ */
+static int imx586_get_frame_desc(struct v4l2_subdev *sd, unsigned int pad,
+				 struct v4l2_mbus_frame_desc *fd)
+{
+	struct imx586 *imx586 = to_imx586(sd);
+	struct imx586_active_fmt active;
+	unsigned int i;
+	u32 code;
+
+	if (pad != IMAGE_PAD)
+		return -EINVAL;
+
+	imx586_read_active(imx586, &active);
+	code = imx586_get_format_code(imx586, active.code);
+
+	memset(fd, 0, sizeof(*fd));
+	fd->type = V4L2_MBUS_FRAME_DESC_TYPE_CSI2;
+	fd->num_entries = active.mode->dol ? 2 : 1;
+	for (i = 0; i < fd->num_entries; i++) {
+		fd->entry[i].stream = i;
+		fd->entry[i].pixelcode = code;
+		fd->entry[i].bus.csi2.vc = i;
+		fd->entry[i].bus.csi2.dt = imx586_csi2_dt(active.mode);
+	}
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops imx586_pad_ops = {
 	.enum_mbus_code = imx586_enum_mbus_code,
 	.get_fmt = imx586_get_pad_format,
 	.set_fmt = imx586_set_pad_format,
 	.get_selection = imx586_get_selection,
+	.set_selection = imx586_set_selection,
 	.enum_frame_size = imx586_enum_frame_size,
+	.get_frame_desc = imx586_get_frame_desc,
 };
 
 static const struct v4l2_subdev_ops imx586_subdev_ops = {
@@ -1778,15 +4212,174 @@ static const struct v4l2_subdev_internal_ops imx586_internal_ops = {
 };
 
 /* Initialize control handlers */
+/* Blocks until deferred control writes have reached the sensor */
+static const struct v4l2_ctrl_config imx586_ctrl_fence = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_CTRL_FENCE,
+	.name = "Control Fence",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+/* Pipeline delays for exposure, analogue gain and vblank, in frames */
+static const struct v4l2_ctrl_config imx586_ctrl_delays = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_CTRL_DELAYS,
+	.name = "Control Delays",
+	.type = V4L2_CTRL_TYPE_U8,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY,
+	.min = 0,
+	.max = 0xff,
+	.step = 1,
+	.def = IMX586_CTRL_DELAY_FRAMES,
+	.dims = { IMX586_NUM_CTRL_DELAYS },
+};
+
+static const char * const imx586_sync_mode_menu[] = {
+	"Off",
+	"Leader",
+	"Follower",
+};
+
+static const struct v4l2_ctrl_config imx586_ctrl_sync_mode = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_SYNC_MODE,
+	.name = "Sync Mode",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.max = ARRAY_SIZE(imx586_sync_mode_menu) - 1,
+	.qmenu = imx586_sync_mode_menu,
+};
+
+static const char * const imx586_sync_status_menu[] = {
+	"Unknown",
+	"No Signal",
+	"Unstable",
+	"Locked",
+};
+
+static const struct v4l2_ctrl_config imx586_ctrl_sync_status = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_SYNC_STATUS,
+	.name = "Sync Status",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	.max = ARRAY_SIZE(imx586_sync_status_menu) - 1,
+	.qmenu = imx586_sync_status_menu,
+};
+
+/*
+ * The IMX586 has no documented embedded data output, so the per-frame
+ * state is handed out through this control rather than the metadata pad.
+ */
+static const struct v4l2_ctrl_config imx586_ctrl_frame_state = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_FRAME_STATE,
+	.name = "Frame State",
+	.type = V4L2_CTRL_TYPE_U32,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	.min = 0,
+	.max = U32_MAX,
+	.step = 1,
+	.dims = { IMX586_NUM_FRAME_STATE },
+};
+
+/* DOL short frame exposure in lines, clamped to the frame at VBLANK */
+static const struct v4l2_ctrl_config imx586_ctrl_short_exposure = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_SHORT_EXPOSURE,
+	.name = "Short Exposure",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_INACTIVE,
+	.min = IMX586_DOL_SHORT_EXPOSURE_MIN,
+	.max = IMX586_VMAX_MAX,
+	.step = 1,
+	.def = IMX586_DOL_SHORT_EXPOSURE_DEFAULT,
+};
+
+static const struct v4l2_ctrl_config imx586_ctrl_short_gain = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_SHORT_GAIN,
+	.name = "Short Analogue Gain",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_INACTIVE,
+	.min = IMX586_ANA_GAIN_MIN,
+	.max = IMX586_ANA_GAIN_MAX,
+	.step = IMX586_ANA_GAIN_STEP,
+	.def = IMX586_ANA_GAIN_DEFAULT,
+};
+
+/* Clear HDR combining thresholds, in 12-bit sensor output levels */
+static const struct v4l2_ctrl_config imx586_ctrl_hdr_th_high = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_HDR_TH_HIGH,
+	.name = "HDR Threshold High",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_INACTIVE,
+	.min = 0,
+	.max = IMX586_EXP_TH_MAX,
+	.step = 1,
+	.def = IMX586_EXP_TH_H_DEFAULT,
+};
+
+static const struct v4l2_ctrl_config imx586_ctrl_hdr_th_low = {
+	.ops = &imx586_ctrl_ops,
+	.id = IMX586_CID_HDR_TH_LOW,
+	.name = "HDR Threshold Low",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_INACTIVE,
+	.min = 0,
+	.max = IMX586_EXP_TH_MAX,
+	.step = 1,
+	.def = IMX586_EXP_TH_L_DEFAULT,
+};
+
+/*
+ * CCMP1, ACMP1, CCMP2, ACMP2 of the non-linear mode. Array defaults are
+ * per element, so the default curve is set once the control exists.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+/* Array elements only share one default, so initialise the knees here */
+static void imx586_gc_knees_init(const struct v4l2_ctrl *ctrl, u32 from_idx,
+				 union v4l2_ctrl_ptr ptr)
+{
+	unsigned int i;
+
+	for (i = from_idx; i < IMX586_NUM_GC_KNEES; i++)
+		ptr.p_u32[i] = imx586_gc_knees_default[i];
+}
+
+static const struct v4l2_ctrl_type_ops imx586_gc_knees_type_ops = {
+	.equal = v4l2_ctrl_type_op_equal,
+	.init = imx586_gc_knees_init,
+	.log = v4l2_ctrl_type_op_log,
+	.validate = v4l2_ctrl_type_op_validate,
+};
+#endif
+
+static const struct v4l2_ctrl_config imx586_ctrl_gc_knees = {
+	.ops = &imx586_ctrl_ops,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	.type_ops = &imx586_gc_knees_type_ops,
+#endif
+	.id = IMX586_CID_GC_KNEES,
+	.name = "Gradation Compression Knees",
+	.type = V4L2_CTRL_TYPE_U32,
+	.flags = V4L2_CTRL_FLAG_INACTIVE,
+	.min = 0,
+	.max = IMX586_CCMP_MAX,
+	.step = 1,
+	.dims = { IMX586_NUM_GC_KNEES },
+};
+
 static int imx586_init_controls(struct imx586 *imx586)
 {
 	struct v4l2_ctrl_handler *ctrl_hdlr;
 	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
 	struct v4l2_fwnode_device_properties props;
+	struct v4l2_ctrl_config sync_mode, hdr_th_high, hdr_th_low, ctrl_delays;
 	int ret;
 
 	ctrl_hdlr = &imx586->ctrl_handler;
-	ret = v4l2_ctrl_handler_init(ctrl_hdlr, 16);
+	ret = v4l2_ctrl_handler_init(ctrl_hdlr, 27);
 	if (ret)
 		return ret;
 
@@ -1803,24 +4396,44 @@ static int imx586_init_controls(struct imx586 *imx586)
 					       0xffff,
 					       0xffff, 1,
 					       0xffff);
-	imx586->vblank = v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops,
-					   V4L2_CID_VBLANK, 0, 0xfffff, 1, 0);
 	imx586->hblank = v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops,
 					   V4L2_CID_HBLANK, 0, 0xffff, 1, 0);
 
+	/* Fixed by the endpoint, only reported */
+	imx586->link_freq = v4l2_ctrl_new_int_menu(ctrl_hdlr, &imx586_ctrl_ops,
+						   V4L2_CID_LINK_FREQ,
+						   ARRAY_SIZE(imx586_link_freqs) - 1,
+						   imx586->link_freq_idx,
+						   imx586_link_freqs);
+	if (imx586->link_freq)
+		imx586->link_freq->flags |= V4L2_CTRL_FLAG_READ_ONLY;
+
 	imx586->exposure = v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops,
 					     V4L2_CID_EXPOSURE,
 					     IMX586_EXPOSURE_MIN,
 					     IMX586_EXPOSURE_MAX,
 					     IMX586_EXPOSURE_STEP,
 					     IMX586_EXPOSURE_DEFAULT);
-/*
-	v4l2_ctrl_new_std(&imx586->ctrls, &imx586_ctrl_ops,
-                          V4L2_CID_ANALOGUE_GAIN, 0, 240, 1, 0);
-*/
-	v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops, V4L2_CID_ANALOGUE_GAIN,
-			  IMX586_ANA_GAIN_MIN, IMX586_ANA_GAIN_MAX,
-			  IMX586_ANA_GAIN_STEP, IMX586_ANA_GAIN_DEFAULT);
+	imx586->gain = v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops,
+					 V4L2_CID_ANALOGUE_GAIN,
+					 IMX586_ANA_GAIN_MIN, IMX586_ANA_GAIN_MAX,
+					 IMX586_ANA_GAIN_STEP, IMX586_ANA_GAIN_DEFAULT);
+	imx586->vblank = v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops,
+					   V4L2_CID_VBLANK, 0, 0xfffff, 1, 0);
+	imx586->short_exposure = v4l2_ctrl_new_custom(ctrl_hdlr,
+						      &imx586_ctrl_short_exposure,
+						      NULL);
+	imx586->short_gain = v4l2_ctrl_new_custom(ctrl_hdlr,
+						  &imx586_ctrl_short_gain, NULL);
+	hdr_th_high = imx586_ctrl_hdr_th_high;
+	hdr_th_high.def = imx586->hdr_th_def[0];
+	hdr_th_low = imx586_ctrl_hdr_th_low;
+	hdr_th_low.def = imx586->hdr_th_def[1];
+	imx586->hdr_th_high = v4l2_ctrl_new_custom(ctrl_hdlr, &hdr_th_high,
+						   NULL);
+	imx586->hdr_th_low = v4l2_ctrl_new_custom(ctrl_hdlr, &hdr_th_low, NULL);
+	imx586->gc_knees = v4l2_ctrl_new_custom(ctrl_hdlr,
+						&imx586_ctrl_gc_knees, NULL);
 
 
     imx586->hflip = v4l2_ctrl_new_std(ctrl_hdlr, &imx586_ctrl_ops, V4L2_CID_HFLIP, 0, 1, 1, 0);
@@ -1832,6 +4445,19 @@ static int imx586_init_controls(struct imx586 *imx586)
 		imx586->vflip->flags |= V4L2_CTRL_FLAG_MODIFY_LAYOUT;
 */
 
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx586_ctrl_fence, NULL);
+	/* Controls are only deferred while streaming, which is what counts */
+	ctrl_delays = imx586_ctrl_delays;
+	if (imx586->ctrl_worker && imx586->xvs_irq)
+		ctrl_delays.def = IMX586_CTRL_DELAY_XVS_FRAMES;
+	v4l2_ctrl_new_custom(ctrl_hdlr, &ctrl_delays, NULL);
+
+	sync_mode = imx586_ctrl_sync_mode;
+	sync_mode.def = imx586->sync_mode;
+	imx586->sync_ctrl = v4l2_ctrl_new_custom(ctrl_hdlr, &sync_mode, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx586_ctrl_sync_status, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx586_ctrl_frame_state, NULL);
+
 	if (ctrl_hdlr->error) {
 		ret = ctrl_hdlr->error;
 		dev_err(&client->dev, "%s control init failed (%d)\n",
@@ -1839,6 +4465,14 @@ static int imx586_init_controls(struct imx586 *imx586)
 		goto error;
 	}
 
+	/* Per-frame AE updates land together in one grouped hold */
+	v4l2_ctrl_cluster(5, &imx586->exposure);
+	/* The exposure range follows the frame length and DOL short frame */
+	v4l2_ctrl_notify(imx586->vblank, imx586_ctrl_notify, imx586);
+	v4l2_ctrl_notify(imx586->short_exposure, imx586_ctrl_notify, imx586);
+	/* Flips are applied live, as one change on a frame boundary */
+	v4l2_ctrl_cluster(2, &imx586->vflip);
+
 	ret = v4l2_fwnode_device_parse(&client->dev, &props);
 	if (ret)
 		goto error;
@@ -1850,6 +4484,11 @@ static int imx586_init_controls(struct imx586 *imx586)
 
 	imx586->sd.ctrl_handler = ctrl_hdlr;
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+	__v4l2_ctrl_s_ctrl_compound(imx586->gc_knees, V4L2_CTRL_TYPE_U32,
+				    imx586_gc_knees_default);
+#endif
+
 	/* Setup exposure and frame/line length limits. */
 	imx586_set_framing_limits(imx586);
 
@@ -1862,6 +4501,227 @@ error:
 	return ret;
 }
 
+static void imx586_hist_show(struct seq_file *m, const char *name,
+			     const struct imx586_hist *h)
+{
+	unsigned int i;
+
+	if (!h->count)
+		return;
+
+	seq_printf(m, "%-16s count %llu avg %llu us max %llu us |", name,
+		   h->count, div_u64(h->total_ns, h->count) / NSEC_PER_USEC,
+		   h->max_ns / NSEC_PER_USEC);
+	for (i = 0; i < IMX586_HIST_BUCKETS; i++)
+		seq_printf(m, " %u", h->bucket[i]);
+	seq_putc(m, '\n');
+}
+
+static int imx586_stats_show(struct seq_file *m, void *data)
+{
+	struct imx586 *imx586 = m->private;
+	struct imx586_stats *st = &imx586->stats;
+	struct imx586_stats *snap;
+	unsigned long flags;
+	unsigned int i;
+
+	/*
+	 * The writers keep interrupts off while they hold the lock, so only
+	 * copy the counters under it and format them afterwards. The copy's
+	 * own lock is never used.
+	 */
+	snap = kmalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&st->lock, flags);
+	memcpy(snap->hist, st->hist, sizeof(snap->hist));
+	memcpy(snap->ctrl, st->ctrl, sizeof(snap->ctrl));
+	snap->i2c_errors = st->i2c_errors;
+	snap->i2c_retries = st->i2c_retries;
+	snap->i2c_xfers = st->i2c_xfers;
+	snap->i2c_bytes = st->i2c_bytes;
+	snap->stream_on_xfers = st->stream_on_xfers;
+	snap->stream_on_bytes = st->stream_on_bytes;
+	spin_unlock_irqrestore(&st->lock, flags);
+
+	seq_puts(m, "histogram buckets: <1 us, then powers of two up to >=16 ms\n");
+	for (i = 0; i < IMX586_NUM_STATS; i++)
+		imx586_hist_show(m, imx586_stat_names[i], &snap->hist[i]);
+	for (i = 0; i < ARRAY_SIZE(imx586_stat_ctrls); i++)
+		imx586_hist_show(m, imx586_stat_ctrls[i].name, &snap->ctrl[i]);
+
+	seq_printf(m, "i2c_xfers %llu\ni2c_bytes %llu\ni2c_errors %llu\ni2c_retries %llu\n",
+		   snap->i2c_xfers, snap->i2c_bytes, snap->i2c_errors,
+		   snap->i2c_retries);
+	seq_printf(m, "i2c_clock_hz %u\ni2c_burst_limit %u\n",
+		   imx586->i2c_hz, imx586_max_burst(imx586));
+	seq_printf(m, "stream_on_xfers %llu\nstream_on_bytes %llu\n",
+		   snap->stream_on_xfers, snap->stream_on_bytes);
+
+	kfree(snap);
+
+	return 0;
+}
+
+/*
+ * Bus time of @xfers writes carrying @bytes bytes (register address
+ * included) at @hz: a start, the device address and every byte take nine
+ * clocks with their ACK, and a stop closes each write.
+ */
+static u64 imx586_bus_time_us(u64 xfers, u64 bytes, unsigned int hz)
+{
+	return div_u64((xfers * (1 + 9 + 1) + bytes * 9) * USEC_PER_SEC, hz);
+}
+
+static const unsigned int imx586_bus_model_hz[] = { 100000, 400000, 1000000 };
+
+static void imx586_bus_model_show(struct seq_file *m, const char *name,
+				  u64 xfers, u64 bytes)
+{
+	unsigned int i;
+
+	seq_printf(m, "%-24s xfers %llu bytes %llu |", name, xfers, bytes);
+	for (i = 0; i < ARRAY_SIZE(imx586_bus_model_hz); i++)
+		seq_printf(m, " %ukHz %llu us", imx586_bus_model_hz[i] / 1000,
+			   imx586_bus_time_us(xfers, bytes,
+					      imx586_bus_model_hz[i]));
+	seq_putc(m, '\n');
+}
+
+/* Writes imx586_write_regs() needs for @list with a cold register cache */
+static void imx586_bus_model_list(struct imx586 *imx586,
+				  const struct IMX586_reg_list *list,
+				  u64 *xfers, u64 *bytes)
+{
+	unsigned int max_burst = imx586_max_burst(imx586);
+	const u8 *p = list->bursts;
+	unsigned int i, n;
+
+	if (p) {
+		for (i = 0; i < list->num_of_regs; i += n, p += 3 + n) {
+			n = p[2];
+			*xfers += DIV_ROUND_UP(n, max_burst);
+			*bytes += 2 * DIV_ROUND_UP(n, max_burst) + n;
+		}
+		return;
+	}
+
+	for (i = 0; i < list->num_of_regs; i += n) {
+		for (n = 1; i + n < list->num_of_regs && n < max_burst; n++)
+			if (list->regs[i + n].address != list->regs[i].address + n)
+				break;
+		(*xfers)++;
+		*bytes += 2 + n;
+	}
+}
+
+/*
+ * Modelled cost of a cold stream on for every mode, from the common and
+ * mode tables in use, plus the traffic actually seen on the last one.
+ */
+static int imx586_bus_model_seq_show(struct seq_file *m, void *data)
+{
+	struct imx586 *imx586 = m->private;
+	u64 common_xfers = 0, common_bytes = 0;
+	unsigned int d, x, i;
+	unsigned long flags;
+	u64 xfers, bytes;
+	char name[32];
+
+	mutex_lock(&imx586->mutex);
+
+	imx586_bus_model_list(imx586, imx586_common_regs(imx586), &common_xfers,
+			      &common_bytes);
+	imx586_bus_model_show(m, "common", common_xfers, common_bytes);
+
+	for (d = 0; d < IMX586_NUM_DEPTHS; d++) {
+		for (x = 0; x < IMX586_NUM_XFER_CLASSES; x++) {
+			const struct imx586_mode_table *t = &imx586_mode_registry[d][x];
+
+			/* 10 and 16-bit list the same modes for every class */
+			if (x && t->modes == imx586_mode_registry[d][0].modes)
+				continue;
+
+			for (i = 0; i < t->num_modes; i++) {
+				const struct imx586_mode *mode = &t->modes[i];
+
+				xfers = common_xfers;
+				bytes = common_bytes;
+				imx586_bus_model_list(imx586,
+						      imx586_mode_regs(imx586, mode),
+						      &xfers, &bytes);
+				snprintf(name, sizeof(name), "%ux%u-%u%s",
+					 mode->width, mode->height, mode->bpp,
+					 mode->dol ? "-dol" :
+					 !mode->linear ? "-gc" : "");
+				imx586_bus_model_show(m, name, xfers, bytes);
+			}
+		}
+	}
+
+	mutex_unlock(&imx586->mutex);
+
+	spin_lock_irqsave(&imx586->stats.lock, flags);
+	xfers = imx586->stats.stream_on_xfers;
+	bytes = imx586->stats.stream_on_bytes;
+	spin_unlock_irqrestore(&imx586->stats.lock, flags);
+	if (xfers)
+		imx586_bus_model_show(m, "last stream on", xfers, bytes);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(imx586_bus_model_seq);
+
+static int imx586_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, imx586_stats_show, inode->i_private);
+}
+
+/* Any write clears the counters */
+static ssize_t imx586_stats_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct imx586 *imx586 = ((struct seq_file *)file->private_data)->private;
+	struct imx586_stats *st = &imx586->stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&st->lock, flags);
+	memset(st->hist, 0, sizeof(st->hist));
+	memset(st->ctrl, 0, sizeof(st->ctrl));
+	st->i2c_errors = 0;
+	st->i2c_retries = 0;
+	st->i2c_xfers = 0;
+	st->i2c_bytes = 0;
+	st->stream_on_xfers = 0;
+	st->stream_on_bytes = 0;
+	spin_unlock_irqrestore(&st->lock, flags);
+
+	return count;
+}
+
+static const struct file_operations imx586_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = imx586_stats_open,
+	.read = seq_read,
+	.write = imx586_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void imx586_debugfs_init(struct imx586 *imx586)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	char name[32];
+
+	snprintf(name, sizeof(name), "imx586-%s", dev_name(&client->dev));
+	imx586->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("stats", 0600, imx586->debugfs, imx586,
+			    &imx586_stats_fops);
+	debugfs_create_file("bus_model", 0400, imx586->debugfs, imx586,
+			    &imx586_bus_model_seq_fops);
+}
+
 static void imx586_free_controls(struct imx586 *imx586)
 {
 	v4l2_ctrl_handler_free(imx586->sd.ctrl_handler);
@@ -1881,6 +4741,137 @@ static const struct of_device_id imx586_dt_ids[] = {
 	{ /* sentinel */ }
 };
 
+/* Pick the lane count and the first DT link frequency the sensor supports */
+static int imx586_parse_endpoint(struct imx586 *imx586)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct device *dev = &client->dev;
+	struct v4l2_fwnode_endpoint ep_cfg = {
+		.bus_type = V4L2_MBUS_CSI2_DPHY,
+	};
+	struct fwnode_handle *endpoint;
+	unsigned int i, j;
+	int ret;
+
+	endpoint = fwnode_graph_get_next_endpoint(dev_fwnode(dev), NULL);
+	if (!endpoint) {
+		dev_err(dev, "endpoint node not found\n");
+		return -EINVAL;
+	}
+
+	ret = v4l2_fwnode_endpoint_alloc_parse(endpoint, &ep_cfg);
+	fwnode_handle_put(endpoint);
+	if (ret) {
+		dev_err(dev, "could not parse endpoint: %d\n", ret);
+		return ret;
+	}
+
+	imx586->lanes = ep_cfg.bus.mipi_csi2.num_data_lanes;
+	if (imx586->lanes != 2 && imx586->lanes != 4) {
+		dev_err(dev, "only 2 or 4 data lanes are supported, not %u\n",
+			imx586->lanes);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < ep_cfg.nr_of_link_frequencies; i++) {
+		for (j = 0; j < ARRAY_SIZE(imx586_link_freqs); j++)
+			if (ep_cfg.link_frequencies[i] == imx586_link_freqs[j])
+				break;
+		if (j < ARRAY_SIZE(imx586_link_freqs))
+			break;
+	}
+
+	if (i == ep_cfg.nr_of_link_frequencies) {
+		dev_err(dev, "no supported link frequency in DT\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	imx586->link_freq_idx = j;
+	dev_info(dev, "%u lanes at %lld Hz\n", imx586->lanes,
+		 imx586_link_freqs[j]);
+
+out:
+	v4l2_fwnode_endpoint_free(&ep_cfg);
+
+	return ret;
+}
+
+/*
+ * Bus clock of the controller behind any muxes, as set by its
+ * clock-frequency property. The sensor supports up to Fast-mode Plus.
+ */
+static u32 imx586_i2c_clock(struct i2c_client *client)
+{
+	struct i2c_adapter *root = client->adapter, *parent;
+	u32 hz = I2C_MAX_STANDARD_MODE_FREQ;
+
+	while ((parent = i2c_parent_is_i2c_adapter(root)))
+		root = parent;
+
+	if (root->dev.parent)
+		device_property_read_u32(root->dev.parent, "clock-frequency", &hz);
+
+	if (hz > I2C_MAX_FAST_MODE_PLUS_FREQ)
+		dev_warn(&client->dev,
+			 "I2C bus at %u Hz, above the sensor's 1 MHz limit\n", hz);
+	else
+		dev_dbg(&client->dev, "I2C bus at %u Hz\n", hz);
+
+	return hz;
+}
+
+/*
+ * Settings that may differ between sensors on one system. Each defaults
+ * to its module parameter, so rigs mixing mono and colour sensors, or
+ * with different bus and power policies, need no module reload.
+ */
+static int imx586_parse_config(struct imx586 *imx586)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx586->sd);
+	struct device *dev = &client->dev;
+	u32 val;
+
+	imx586->mono = monochrome_mode;
+	if (!of_property_read_u32(dev->of_node, "mono-mode", &val))
+		imx586->mono = val;
+	dev_info(dev, "IMX586 mono option: %d\n", imx586->mono);
+
+	imx586->async_ctrls = async_ctrls;
+	if (!of_property_read_u32(dev->of_node, "sony,async-controls", &val))
+		imx586->async_ctrls = val;
+
+	imx586->warm_standby = -1;
+	if (!of_property_read_u32(dev->of_node, "sony,warm-standby", &val))
+		imx586->warm_standby = !!val;
+
+	imx586->autosuspend_delay_ms = autosuspend_delay_ms;
+	of_property_read_u32(dev->of_node, "sony,autosuspend-delay-ms",
+			     &imx586->autosuspend_delay_ms);
+
+	imx586->burst_len = 0;
+	if (!of_property_read_u32(dev->of_node, "sony,burst-length", &val)) {
+		if (!val || val > IMX586_MAX_BURST_LEN) {
+			dev_err(dev, "invalid sony,burst-length %u\n", val);
+			return -EINVAL;
+		}
+		imx586->burst_len = val;
+	}
+
+	imx586->hdr_th_def[0] = IMX586_EXP_TH_H_DEFAULT;
+	imx586->hdr_th_def[1] = IMX586_EXP_TH_L_DEFAULT;
+	if (!of_property_read_u32_array(dev->of_node, "sony,hdr-thresholds",
+					imx586->hdr_th_def, 2) &&
+	    (imx586->hdr_th_def[0] > IMX586_EXP_TH_MAX ||
+	     imx586->hdr_th_def[1] > IMX586_EXP_TH_MAX)) {
+		dev_err(dev, "invalid sony,hdr-thresholds\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int imx586_probe(struct i2c_client *client)
 {
 	struct device *dev = &client->dev;
@@ -1895,18 +4886,49 @@ static int imx586_probe(struct i2c_client *client)
 
 	v4l2_i2c_subdev_init(&imx586->sd, client, &imx586_subdev_ops);
 
+	/* Batched writes go out as multi-message i2c_transfer() calls */
+	if (!i2c_check_functionality(client->adapter, I2C_FUNC_I2C)) {
+		dev_err(dev, "I2C adapter does not support plain I2C transfers\n");
+		return -ENODEV;
+	}
+	imx586->i2c_hz = imx586_i2c_clock(client);
+	imx586->burst_limit = IMX586_MAX_BURST_LEN;
+
+	imx586->regmap = devm_regmap_init_i2c(client, &imx586_regmap_config);
+	if (IS_ERR(imx586->regmap)) {
+		dev_err(dev, "failed to initialise regmap\n");
+		return PTR_ERR(imx586->regmap);
+	}
+
+	imx586->shadow = devm_kzalloc(dev, sizeof(*imx586->shadow), GFP_KERNEL);
+	if (!imx586->shadow)
+		return -ENOMEM;
+	spin_lock_init(&imx586->shadow->lock);
+
 	match = of_match_device(imx586_dt_ids, dev);
 	if (!match)
 		return -ENODEV;
 	imx586->compatible_data =
 		(const struct imx586_compatible_data *)match->data;
 
-    /* From imx477.c */
-    /* Default the mono mode from OF to -1, which means invalid */
-    ret = of_property_read_u32(dev->of_node, "mono-mode", &tm_of);
-    imx586->mono = (ret == 0);
-    dev_info(dev, "IMX586 mono option: %d\n", imx586->mono);
+	ret = imx586_parse_config(imx586);
+	if (ret)
+		return ret;
+
+	ret = imx586_parse_endpoint(imx586);
+	if (ret)
+		return ret;
 
+	/* Per-board power up timing, falling back to the worst case */
+	imx586->xclr_delay_us = 0;
+	imx586->ready_timeout_us = imx586_XCLR_MIN_DELAY_US;
+	imx586->stream_delay_us = IMX586_STREAM_DELAY_US;
+	of_property_read_u32(dev->of_node, "sony,xclr-delay-us",
+			     &imx586->xclr_delay_us);
+	of_property_read_u32(dev->of_node, "sony,ready-timeout-us",
+			     &imx586->ready_timeout_us);
+	of_property_read_u32(dev->of_node, "sony,stream-delay-us",
+			     &imx586->stream_delay_us);
 
 	/* Get system clock (xclk) */
 	imx586->xclk = devm_clk_get(dev, NULL);
@@ -1928,35 +4950,79 @@ static int imx586_probe(struct i2c_client *client)
 		return ret;
 	}
 
-	/* Request optional enable pin */
+	/* Request optional enable pin, holding XCLR low until power on */
 	imx586->reset_gpio = devm_gpiod_get_optional(dev, "reset",
-						     GPIOD_OUT_HIGH);
-	
-	/*
-	 * The sensor must be powered for imx586_identify_module()
-	 * to be able to read the CHIP_ID register
-	 */
-	ret = imx586_power_on(dev);
-	if (ret)
-		return ret;
+						     GPIOD_OUT_LOW);
 
-	ret = imx586_identify_module(imx586, imx586->compatible_data->chip_id);
-	if (ret)
-		goto error_power_off;
+	imx586->defer_identify = of_property_read_bool(dev->of_node,
+						       "sony,defer-identify");
+
+	ret = of_property_read_u32(dev->of_node, "sony,sync-mode", &tm_of);
+	if (!ret) {
+		if (tm_of > IMX586_SYNC_FOLLOWER) {
+			dev_err(dev, "invalid sony,sync-mode %u\n", tm_of);
+			return -EINVAL;
+		}
+		imx586->sync_mode = tm_of;
+	}
 
 	/* Initialize default format */
+	seqlock_init(&imx586->active_lock);
 	imx586_set_default_format(imx586);
 
-	/* Enable runtime PM and turn off the device */
-	pm_runtime_set_active(dev);
+	if (imx586->async_ctrls) {
+		imx586->ctrl_worker = kthread_create_worker(0, "imx586-%s",
+							    dev_name(dev));
+		if (IS_ERR(imx586->ctrl_worker)) {
+			ret = PTR_ERR(imx586->ctrl_worker);
+			imx586->ctrl_worker = NULL;
+			dev_err(dev, "failed to create control worker: %d\n",
+				ret);
+			goto error_power_off;
+		}
+		kthread_init_work(&imx586->ctrl_work, imx586_ctrl_work);
+		sched_set_fifo(imx586->ctrl_worker->task);
+	}
+
+	spin_lock_init(&imx586->state_lock);
+	spin_lock_init(&imx586->stats.lock);
+
+	/* Optional XVS line, only armed while streaming */
+	if (client->irq > 0) {
+		ret = devm_request_irq(dev, client->irq, imx586_xvs_irq,
+				       IRQF_NO_AUTOEN, dev_name(dev), imx586);
+		if (ret) {
+			dev_err(dev, "failed to request XVS irq: %d\n", ret);
+			goto error_power_off;
+		}
+		imx586->xvs_irq = client->irq;
+	}
+
+	/*
+	 * Runtime PM starts out suspended, so nothing below waits for the
+	 * sensor to power up.
+	 */
+	pm_runtime_set_autosuspend_delay(dev, imx586->autosuspend_delay_ms);
+	pm_runtime_use_autosuspend(dev);
 	pm_runtime_enable(dev);
-	pm_runtime_idle(dev);
 
 	/* This needs the pm runtime to be registered. */
 	ret = imx586_init_controls(imx586);
 	if (ret)
 		goto error_power_off;
 
+	/*
+	 * Identification happens on the first cold power up. Unless DT defers
+	 * it to first use, power up once here so a missing sensor fails probe.
+	 */
+	if (!imx586->defer_identify) {
+		ret = pm_runtime_resume_and_get(dev);
+		if (ret)
+			goto error_handler_free;
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+
 	/* Initialize subdev */
 	imx586->sd.internal_ops = &imx586_internal_ops;
 	imx586->sd.flags |= V4L2_SUBDEV_FL_HAS_DEVNODE |
@@ -1979,6 +5045,16 @@ static int imx586_probe(struct i2c_client *client)
 		goto error_media_entity;
 	}
 
+	imx586_debugfs_init(imx586);
+
+	/* Picked up in the background, the built-in tables serve until then */
+	init_completion(&imx586->fw_done);
+	ret = request_firmware_nowait(THIS_MODULE, FW_ACTION_UEVENT,
+				      IMX586_FW_NAME, dev, GFP_KERNEL, imx586,
+				      imx586_fw_loaded);
+	if (ret)
+		complete(&imx586->fw_done);
+
 	return 0;
 
 error_media_entity:
@@ -1988,9 +5064,12 @@ error_handler_free:
 	imx586_free_controls(imx586);
 
 error_power_off:
+	if (imx586->ctrl_worker)
+		kthread_destroy_worker(imx586->ctrl_worker);
 	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 	pm_runtime_set_suspended(&client->dev);
-	imx586_power_off(&client->dev);
+	imx586_power_off_full(imx586);
 
 	return ret;
 }
@@ -2000,13 +5079,17 @@ static void imx586_remove(struct i2c_client *client)
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx586 *imx586 = to_imx586(sd);
 
+	wait_for_completion(&imx586->fw_done);
+	debugfs_remove_recursive(imx586->debugfs);
 	v4l2_async_unregister_subdev(sd);
 	media_entity_cleanup(&sd->entity);
 	imx586_free_controls(imx586);
+	if (imx586->ctrl_worker)
+		kthread_destroy_worker(imx586->ctrl_worker);
 
 	pm_runtime_disable(&client->dev);
-	if (!pm_runtime_status_suspended(&client->dev))
-		imx586_power_off(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	imx586_power_off_full(imx586);
 	pm_runtime_set_suspended(&client->dev);
 
 }
@@ -2023,6 +5106,7 @@ static struct i2c_driver imx586_i2c_driver = {
 		.name = "imx586",
 		.of_match_table	= imx586_dt_ids,
 		.pm = &imx586_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = imx586_probe,
 	.remove = imx586_remove,
@@ -2030,9 +5114,14 @@ static struct i2c_driver imx586_i2c_driver = {
 
 module_i2c_driver(imx586_i2c_driver);
 
+#ifdef IMX586_KUNIT_TEST
+#include "imx586_kunit.c"
+#endif
+
 MODULE_AUTHOR("Will Whang <will@willwhang.com>");
 MODULE_AUTHOR("Tetsuya NOMURA <tetsuya.nomura@soho-enterprise.com>");
 MODULE_AUTHOR("Russell Newman <russellnewman@octopuscinema.com>");
 MODULE_AUTHOR("Marcin Paszkuta <marcin.paszkuta@optimedio.com>");
 MODULE_DESCRIPTION("Sony imx586 sensor driver");
+MODULE_FIRMWARE(IMX586_FW_NAME);
 MODULE_LICENSE("GPL v2");
\ No newline at end of file
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Sony imx586 definitions shared by the driver and the virtual I2C bus.
+ *
+ * Copyright (C) 2024 OCTOPUS CINEMA
+ */
+#ifndef _IMX586_H_
+#define _IMX586_H_
+
+/*
+ * Non-standard colorspace transfer functions, selecting gradation
+ * compression, and DOL HDR long/short frame output
+ */
+enum v4l2_xfer_func_sony {
+	V4L2_XFER_FUNC_GRADATION_COMPRESSION = 10,
+	V4L2_XFER_FUNC_DOL_HDR = 11,
+};
+
+#endif /* _IMX586_H_ */
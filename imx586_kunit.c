@@ -0,0 +1,638 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the Sony imx586 driver.
+ *
+ * Built into the module with IMX586_KUNIT_TEST (see Kconfig and Makefile)
+ * and included at the end of imx586.c, so the static helpers are in
+ * scope. The register paths run against a fake regmap bus and a fake I2C
+ * adapter that record every write, so no sensor is needed.
+ *
+ * Copyright (C) 2024 OCTOPUS CINEMA
+ */
+#include <kunit/test.h>
+
+#define IMX586_TEST_MAX_WRITES		1024
+#define IMX586_TEST_LOG_SIZE		16384
+#define IMX586_TEST_MAX_MODES		64
+#define IMX586_TEST_BENCH_LOOPS		1000
+
+/* Every write that reached the fake bus, as register address and data */
+struct imx586_test_bus {
+	unsigned int num_writes;
+	unsigned int log_len;
+	unsigned int num_transfers;
+	bool overflow;
+	/* Writes to fail with -ENXIO before the bus answers again */
+	unsigned int nacks;
+	struct {
+		u16 reg;
+		u16 len;
+		u16 offset;
+	} writes[IMX586_TEST_MAX_WRITES];
+	u8 log[IMX586_TEST_LOG_SIZE];
+};
+
+struct imx586_test {
+	struct imx586 imx586;
+	struct i2c_client client;
+	struct i2c_adapter adapter;
+	struct imx586_test_bus bus;
+	struct v4l2_ctrl exposure;
+	struct v4l2_ctrl gain;
+	struct v4l2_ctrl vblank;
+	struct v4l2_ctrl short_exposure;
+	struct v4l2_ctrl short_gain;
+};
+
+static void imx586_test_bus_reset(struct imx586_test_bus *bus)
+{
+	bus->num_writes = 0;
+	bus->log_len = 0;
+	bus->num_transfers = 0;
+	bus->overflow = false;
+}
+
+/* Log one { be16 address, data... } write */
+static void imx586_test_record(struct imx586_test_bus *bus, const u8 *buf,
+			       size_t count)
+{
+	unsigned int n = bus->num_writes;
+
+	if (count < 2 || n == IMX586_TEST_MAX_WRITES ||
+	    bus->log_len + count - 2 > IMX586_TEST_LOG_SIZE) {
+		bus->overflow = true;
+		return;
+	}
+
+	bus->writes[n].reg = get_unaligned_be16(buf);
+	bus->writes[n].len = count - 2;
+	bus->writes[n].offset = bus->log_len;
+	memcpy(bus->log + bus->log_len, buf + 2, count - 2);
+	bus->log_len += count - 2;
+	bus->num_writes++;
+}
+
+static int imx586_test_regmap_write(void *context, const void *data,
+				    size_t count)
+{
+	struct imx586_test_bus *bus = context;
+
+	if (bus->nacks) {
+		bus->nacks--;
+		return -ENXIO;
+	}
+
+	imx586_test_record(bus, data, count);
+
+	return 0;
+}
+
+static int imx586_test_regmap_read(void *context, const void *reg,
+				   size_t reg_size, void *val, size_t val_size)
+{
+	return -EIO;
+}
+
+static const struct regmap_bus imx586_test_regmap_bus = {
+	.write = imx586_test_regmap_write,
+	.read = imx586_test_regmap_read,
+};
+
+static int imx586_test_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			    int num)
+{
+	struct imx586_test *t = container_of(adap, struct imx586_test, adapter);
+	int i;
+
+	if (t->bus.nacks) {
+		t->bus.nacks--;
+		return -ENXIO;
+	}
+
+	for (i = 0; i < num; i++)
+		imx586_test_record(&t->bus, msgs[i].buf, msgs[i].len);
+	t->bus.num_transfers++;
+
+	return num;
+}
+
+static u32 imx586_test_functionality(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm imx586_test_algo = {
+	.master_xfer = imx586_test_xfer,
+	.functionality = imx586_test_functionality,
+};
+
+/* The fake adapter is never registered, so it has no bus lock of its own */
+static void imx586_test_lock_bus(struct i2c_adapter *adap, unsigned int flags)
+{
+}
+
+static int imx586_test_trylock_bus(struct i2c_adapter *adap,
+				   unsigned int flags)
+{
+	return 1;
+}
+
+static void imx586_test_unlock_bus(struct i2c_adapter *adap,
+				   unsigned int flags)
+{
+}
+
+static const struct i2c_lock_operations imx586_test_lock_ops = {
+	.lock_bus = imx586_test_lock_bus,
+	.trylock_bus = imx586_test_trylock_bus,
+	.unlock_bus = imx586_test_unlock_bus,
+};
+
+static int imx586_test_init(struct kunit *test)
+{
+	struct imx586_test *t;
+	struct imx586 *imx586;
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+	imx586 = &t->imx586;
+
+	t->adapter.algo = &imx586_test_algo;
+	t->adapter.lock_ops = &imx586_test_lock_ops;
+	t->adapter.timeout = HZ;
+	t->client.adapter = &t->adapter;
+	t->client.addr = 0x1a;
+	v4l2_set_subdevdata(&imx586->sd, &t->client);
+
+	imx586->regmap = regmap_init(NULL, &imx586_test_regmap_bus, &t->bus,
+				     &imx586_regmap_config);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(imx586->regmap));
+	imx586->shadow = kunit_kzalloc(test, sizeof(*imx586->shadow), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, imx586->shadow);
+	spin_lock_init(&imx586->shadow->lock);
+
+	spin_lock_init(&imx586->state_lock);
+	spin_lock_init(&imx586->stats.lock);
+	imx586->burst_limit = IMX586_MAX_BURST_LEN;
+	imx586->warm_standby = -1;
+
+	imx586->exposure = &t->exposure;
+	imx586->gain = &t->gain;
+	imx586->vblank = &t->vblank;
+	imx586->short_exposure = &t->short_exposure;
+	imx586->short_gain = &t->short_gain;
+	t->exposure.val = IMX586_EXPOSURE_DEFAULT;
+	t->gain.val = IMX586_ANA_GAIN_DEFAULT;
+	t->short_exposure.val = IMX586_DOL_SHORT_EXPOSURE_DEFAULT;
+
+	test->priv = t;
+
+	return 0;
+}
+
+static void imx586_test_exit(struct kunit *test)
+{
+	struct imx586_test *t = test->priv;
+
+	regmap_exit(t->imx586.regmap);
+}
+
+/* Start every mode at its default timing, as imx586_set_framing_limits() */
+static void imx586_test_set_mode(struct imx586 *imx586,
+				 const struct imx586_mode *mode)
+{
+	imx586->mode = mode;
+	imx586->width = mode->width;
+	imx586->height = mode->height;
+	imx586->crop = mode->crop;
+	imx586->VMAX = mode->default_VMAX;
+	imx586_update_hmax(imx586, mode->default_HMAX);
+}
+
+/* Each mode once, skipping the tables shared by every transfer class */
+static unsigned int imx586_test_modes(const struct imx586_mode **modes)
+{
+	unsigned int d, x, i, n = 0;
+
+	for (d = 0; d < IMX586_NUM_DEPTHS; d++) {
+		for (x = 0; x < IMX586_NUM_XFER_CLASSES; x++) {
+			const struct imx586_mode_table *t = &imx586_mode_registry[d][x];
+
+			if (x && t->modes == imx586_mode_registry[d][0].modes)
+				continue;
+
+			for (i = 0; i < t->num_modes && n < IMX586_TEST_MAX_MODES; i++)
+				modes[n++] = &t->modes[i];
+		}
+	}
+
+	return n;
+}
+
+/*
+ * The exposure range of every mode must map to SHR values the sensor
+ * accepts, and SHR must map back to the exposure within one line.
+ */
+static void imx586_test_exposure_limits(struct kunit *test)
+{
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	const struct imx586_mode *modes[IMX586_TEST_MAX_MODES];
+	unsigned int n = imx586_test_modes(modes);
+	unsigned int i, j, k;
+
+	KUNIT_ASSERT_LT(test, 0U, n);
+
+	for (i = 0; i < n; i++) {
+		const struct imx586_mode *mode = modes[i];
+		const u64 vmax[] = {
+			mode->min_VMAX, mode->default_VMAX, IMX586_VMAX_MAX,
+		};
+
+		imx586_test_set_mode(imx586, mode);
+
+		for (j = 0; j < ARRAY_SIZE(vmax); j++) {
+			u64 min_e, max_e, e[3];
+			u32 shr;
+
+			calculate_min_max_v4l2_cid_exposure(imx586, vmax[j],
+							    mode->min_SHR, 0,
+							    &min_e, &max_e);
+			KUNIT_EXPECT_LE_MSG(test, min_e, max_e,
+					    "%ux%u VMAX %llu", mode->width,
+					    mode->height, vmax[j]);
+
+			e[0] = min_e;
+			e[1] = clamp_t(u64, IMX586_EXPOSURE_DEFAULT, min_e, max_e);
+			e[2] = max_e;
+
+			for (k = 0; k < ARRAY_SIZE(e); k++) {
+				shr = calculate_shr(imx586, e[k], vmax[j], 0);
+
+				KUNIT_EXPECT_GE_MSG(test, shr, mode->min_SHR,
+						    "%ux%u VMAX %llu exposure %llu",
+						    mode->width, mode->height,
+						    vmax[j], e[k]);
+				KUNIT_EXPECT_LE_MSG(test, shr, IMX586_SHR_MAX,
+						    "%ux%u VMAX %llu exposure %llu",
+						    mode->width, mode->height,
+						    vmax[j], e[k]);
+				KUNIT_EXPECT_LT_MSG(test, (u64)shr, vmax[j],
+						    "%ux%u VMAX %llu exposure %llu",
+						    mode->width, mode->height,
+						    vmax[j], e[k]);
+				KUNIT_EXPECT_LE(test,
+						calculate_v4l2_cid_exposure(imx586, vmax[j], shr, 0),
+						e[k]);
+				KUNIT_EXPECT_GE(test,
+						calculate_v4l2_cid_exposure(imx586, vmax[j], shr, 0) + 1,
+						e[k]);
+			}
+		}
+	}
+}
+
+/*
+ * Exposure range and the SHR for IMX586_EXPOSURE_DEFAULT of every mode at
+ * its default timing, worked out by hand from the datasheet: integration
+ * time in lines is VMAX - SHR + 209 / HMAX, and SHR runs from min_SHR (in
+ * DOL, RHS1 + 9) to VMAX - 4. Every mode has HMAX >= 366, so the offset is
+ * under one line: SHR = VMAX - exposure + 1, and the shortest exposure is
+ * 5 lines. DOL places the default 32 line short frame at RHS1 = 41.
+ */
+static const struct {
+	u32 width, height, bpp;
+	bool linear, dol;
+	u64 min_exposure, max_exposure;
+	u32 default_shr;
+} imx586_test_exposure_table[] = {
+	/* VMAX 2250 */
+	{ 3856, 2180, 12, true, false, 5, 2230, 1251 },
+	{ 1928, 1090, 12, true, false, 5, 2230, 1251 },
+	{ 3856, 2180, 10, true, false, 5, 2230, 1251 },
+	{ 1928, 1090, 10, true, false, 5, 2230, 1251 },
+	/* VMAX 1690 */
+	{ 1280, 720, 12, true, false, 5, 1670, 691 },
+	{ 1280, 720, 10, true, false, 5, 1670, 691 },
+	/* VMAX 4500 */
+	{ 3856, 2180, 12, false, false, 5, 4480, 3501 },
+	{ 3856, 2180, 16, true, false, 5, 4480, 3501 },
+	{ 1928, 1090, 16, true, false, 5, 4480, 3501 },
+	/* FSC 4500, min SHR0 = 41 + 9 */
+	{ 3856, 2180, 12, true, true, 5, 4450, 3501 },
+};
+
+static void imx586_test_exposure_values(struct kunit *test)
+{
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	const struct imx586_mode *modes[IMX586_TEST_MAX_MODES];
+	unsigned int n = imx586_test_modes(modes);
+	unsigned int i, j;
+
+	for (i = 0; i < n; i++) {
+		const struct imx586_mode *mode = modes[i];
+		u64 min_e, max_e;
+
+		for (j = 0; j < ARRAY_SIZE(imx586_test_exposure_table); j++)
+			if (imx586_test_exposure_table[j].width == mode->width &&
+			    imx586_test_exposure_table[j].height == mode->height &&
+			    imx586_test_exposure_table[j].bpp == mode->bpp &&
+			    imx586_test_exposure_table[j].linear == mode->linear &&
+			    imx586_test_exposure_table[j].dol == mode->dol)
+				break;
+		KUNIT_EXPECT_LT_MSG(test, j, ARRAY_SIZE(imx586_test_exposure_table),
+				    "%ux%u-%u has no expected values",
+				    mode->width, mode->height, mode->bpp);
+		if (j == ARRAY_SIZE(imx586_test_exposure_table))
+			continue;
+
+		imx586_test_set_mode(imx586, mode);
+		imx586_exposure_limits(imx586, &min_e, &max_e);
+		KUNIT_EXPECT_EQ_MSG(test, min_e,
+				    imx586_test_exposure_table[j].min_exposure,
+				    "%ux%u-%u", mode->width, mode->height,
+				    mode->bpp);
+		KUNIT_EXPECT_EQ_MSG(test, max_e,
+				    imx586_test_exposure_table[j].max_exposure,
+				    "%ux%u-%u", mode->width, mode->height,
+				    mode->bpp);
+		KUNIT_EXPECT_EQ_MSG(test,
+				    calculate_shr(imx586, IMX586_EXPOSURE_DEFAULT,
+						  imx586->VMAX, 0),
+				    imx586_test_exposure_table[j].default_shr,
+				    "%ux%u-%u", mode->width, mode->height,
+				    mode->bpp);
+	}
+}
+
+/* DOL short frame placement keeps every RHS1/SHR1 constraint */
+static void imx586_test_dol_short_exposure(struct kunit *test)
+{
+	static const u32 exposures[] = { 1, 32, 100, 1000, 100000 };
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	const struct imx586_mode *modes[IMX586_TEST_MAX_MODES];
+	unsigned int n = imx586_test_modes(modes);
+	unsigned int i, j, tested = 0;
+
+	for (i = 0; i < n; i++) {
+		if (!modes[i]->dol)
+			continue;
+
+		imx586_test_set_mode(imx586, modes[i]);
+		tested++;
+
+		for (j = 0; j < ARRAY_SIZE(exposures); j++) {
+			u32 rhs1_max = imx586->VMAX - 2 * imx586->height;
+			u32 rhs1, shr1, used;
+
+			t->short_exposure.val = exposures[j];
+			imx586_dol_short_exposure(imx586, &rhs1, &shr1);
+			used = rhs1 + imx586->shr_offset_lines - shr1;
+
+			KUNIT_EXPECT_EQ(test, (rhs1 - 1) % IMX586_DOL_RHS1_STEP, 0U);
+			KUNIT_EXPECT_LE(test, rhs1, rhs1_max);
+			KUNIT_EXPECT_GE(test, shr1, (u32)IMX586_DOL_SHR1_MIN);
+			KUNIT_EXPECT_LE(test, shr1, rhs1);
+			if (rhs1 + IMX586_DOL_RHS1_STEP <= rhs1_max)
+				KUNIT_EXPECT_EQ(test, used, exposures[j]);
+			else
+				KUNIT_EXPECT_LE(test, used, exposures[j]);
+		}
+	}
+
+	KUNIT_EXPECT_LT(test, 0U, tested);
+}
+
+/* Whether an earlier entry left @regs[idx]'s register at the same value */
+static bool imx586_test_already_set(const struct imx586_reg *regs,
+				    unsigned int idx)
+{
+	unsigned int i;
+
+	for (i = idx; i-- > 0;)
+		if (regs[i].address == regs[idx].address)
+			return regs[i].val == regs[idx].val;
+
+	return false;
+}
+
+/*
+ * Upload @list from a cold cache and check the bursts on the bus against
+ * it byte for byte, then again with a warm cache, where only volatile
+ * registers may be sent.
+ */
+static void imx586_test_check_list(struct kunit *test,
+				   const struct IMX586_reg_list *list,
+				   const char *name)
+{
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	struct imx586_test_bus *bus = &t->bus;
+	unsigned int max_burst = imx586_max_burst(imx586);
+	unsigned int i, j, idx = 0;
+	u64 xfers = 0, bytes = 0, sent = 0;
+	bool repeats = false;
+
+	imx586_reg_invalidate(imx586, IMX586_REG_BASE, IMX586_NUM_REGS);
+	imx586_test_bus_reset(bus);
+
+	KUNIT_EXPECT_EQ_MSG(test, imx586_write_regs(imx586, list->regs,
+						    list->num_of_regs), 0,
+			    "%s", name);
+	KUNIT_EXPECT_FALSE(test, bus->overflow);
+
+	for (i = 0; i < bus->num_writes; i++) {
+		const u8 *data = bus->log + bus->writes[i].offset;
+
+		KUNIT_EXPECT_LE_MSG(test, bus->writes[i].len, max_burst,
+				    "%s write %u", name, i);
+		sent += 2 + bus->writes[i].len;
+
+		for (j = 0; j < bus->writes[i].len; j++) {
+			/* Repeats of a value already sent are left out */
+			while (idx < list->num_of_regs &&
+			       list->regs[idx].address != bus->writes[i].reg + j &&
+			       imx586_test_already_set(list->regs, idx))
+				idx++;
+
+			if (idx == list->num_of_regs) {
+				KUNIT_EXPECT_LT_MSG(test, idx, list->num_of_regs,
+						    "%s: extra data on the bus", name);
+				return;
+			}
+
+			KUNIT_EXPECT_EQ_MSG(test, bus->writes[i].reg + j,
+					    list->regs[idx].address,
+					    "%s entry %u", name, idx);
+			KUNIT_EXPECT_EQ_MSG(test, data[j], list->regs[idx].val,
+					    "%s reg 0x%04x", name,
+					    list->regs[idx].address);
+			idx++;
+		}
+	}
+
+	while (idx < list->num_of_regs &&
+	       imx586_test_already_set(list->regs, idx))
+		idx++;
+	KUNIT_EXPECT_EQ_MSG(test, idx, list->num_of_regs,
+			    "%s: entries missing from the bus", name);
+
+	/* The debugfs bus model must predict the same traffic */
+	for (i = 0; i < list->num_of_regs; i++)
+		repeats |= imx586_test_already_set(list->regs, i);
+	if (!repeats) {
+		imx586_bus_model_list(imx586, list, &xfers, &bytes);
+		KUNIT_EXPECT_EQ_MSG(test, (u64)bus->num_writes, xfers, "%s", name);
+		KUNIT_EXPECT_EQ_MSG(test, sent, bytes, "%s", name);
+	}
+
+	imx586_test_bus_reset(bus);
+	KUNIT_EXPECT_EQ(test, imx586_write_regs(imx586, list->regs,
+						list->num_of_regs), 0);
+	for (i = 0; i < bus->num_writes; i++)
+		KUNIT_EXPECT_TRUE_MSG(test,
+				      regmap_reg_in_ranges(bus->writes[i].reg +
+							   bus->writes[i].len - 1,
+							   imx586_volatile_ranges,
+							   ARRAY_SIZE(imx586_volatile_ranges)),
+				      "%s: cached reg 0x%04x resent", name,
+				      bus->writes[i].reg);
+}
+
+static void imx586_test_write_regs(struct kunit *test)
+{
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	const struct imx586_mode *modes[IMX586_TEST_MAX_MODES];
+	unsigned int n = imx586_test_modes(modes);
+	unsigned int i;
+	char name[32];
+
+	imx586_test_check_list(test, imx586_common_regs(imx586), "common");
+
+	for (i = 0; i < n; i++) {
+		snprintf(name, sizeof(name), "%ux%u-%u%s", modes[i]->width,
+			 modes[i]->height, modes[i]->bpp,
+			 modes[i]->dol ? "-dol" : !modes[i]->linear ? "-gc" : "");
+		imx586_test_check_list(test, imx586_mode_regs(imx586, modes[i]),
+				       name);
+	}
+}
+
+/*
+ * NACKed writes are resent, repeated NACKs halve the burst length and
+ * enough good writes double it again
+ */
+static void imx586_test_nack_retry(struct kunit *test)
+{
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	unsigned int i;
+
+	t->bus.nacks = IMX586_I2C_RETRIES;
+	KUNIT_EXPECT_EQ(test, imx586_write_reg_3byte(imx586, IMX586_REG_VMAX,
+						     0x1234), 0);
+	KUNIT_EXPECT_EQ(test, t->bus.num_writes, 1U);
+	KUNIT_EXPECT_EQ(test, imx586->stats.i2c_retries, (u64)IMX586_I2C_RETRIES);
+	KUNIT_EXPECT_EQ(test, imx586->burst_limit, (unsigned int)IMX586_MAX_BURST_LEN);
+
+	/* One write gives up, the next NACK in a row hits the limit */
+	imx586_test_bus_reset(&t->bus);
+	t->bus.nacks = IMX586_I2C_RETRIES + 2;
+	KUNIT_EXPECT_EQ(test, imx586_write_reg_3byte(imx586, IMX586_REG_VMAX,
+						     0x2345), -ENXIO);
+	KUNIT_EXPECT_EQ(test, imx586_write_reg_3byte(imx586, IMX586_REG_VMAX,
+						     0x2345), 0);
+	KUNIT_EXPECT_EQ(test, t->bus.num_writes, 1U);
+	KUNIT_EXPECT_EQ(test, imx586->burst_limit,
+			(unsigned int)IMX586_MAX_BURST_LEN / 2);
+
+	/* A run of good writes restores the full burst length */
+	for (i = 0; i < IMX586_I2C_CLEAN_LIMIT; i++)
+		KUNIT_EXPECT_EQ(test, imx586_write_reg_3byte(imx586,
+							     IMX586_REG_VMAX,
+							     0x3000 + i), 0);
+	KUNIT_EXPECT_EQ(test, imx586->burst_limit,
+			(unsigned int)IMX586_MAX_BURST_LEN);
+}
+
+/*
+ * One exposure cluster update is a single transfer wrapped in a register
+ * hold, and carries the SHR for the requested exposure. Also reports the
+ * cost of the synchronous control path against the fake adapter.
+ */
+static void imx586_test_exposure_cluster(struct kunit *test)
+{
+	struct imx586_test *t = test->priv;
+	struct imx586 *imx586 = &t->imx586;
+	struct imx586_test_bus *bus = &t->bus;
+	const u8 *last;
+	unsigned int i;
+	bool shr_seen = false;
+	u64 start, ns;
+
+	imx586_test_set_mode(imx586, &supported_modes_12bit[0]);
+	t->exposure.is_new = 1;
+	t->gain.is_new = 1;
+	t->vblank.is_new = 1;
+
+	KUNIT_ASSERT_EQ(test, imx586_set_exposure_cluster(imx586), 0);
+	KUNIT_EXPECT_EQ(test, bus->num_transfers, 1U);
+	KUNIT_ASSERT_LT(test, 2U, bus->num_writes);
+
+	KUNIT_EXPECT_EQ(test, bus->writes[0].reg, IMX586_REG_REGHOLD);
+	KUNIT_EXPECT_EQ(test, bus->log[bus->writes[0].offset], 1);
+	last = bus->log + bus->writes[bus->num_writes - 1].offset;
+	KUNIT_EXPECT_EQ(test, bus->writes[bus->num_writes - 1].reg,
+			IMX586_REG_REGHOLD);
+	KUNIT_EXPECT_EQ(test, last[0], 0);
+
+	for (i = 0; i < bus->num_writes; i++) {
+		const u8 *data = bus->log + bus->writes[i].offset;
+
+		if (bus->writes[i].reg != IMX586_REG_SHR)
+			continue;
+		shr_seen = true;
+		KUNIT_EXPECT_EQ(test, get_unaligned_le16(data),
+				calculate_shr(imx586, t->exposure.val,
+					      imx586->VMAX, 0));
+	}
+	KUNIT_EXPECT_TRUE(test, shr_seen);
+
+	/* Per-frame AE: exposure changes every frame, the rest stays put */
+	t->gain.is_new = 0;
+	t->vblank.is_new = 0;
+	start = ktime_get_ns();
+	for (i = 0; i < IMX586_TEST_BENCH_LOOPS; i++) {
+		imx586_test_bus_reset(bus);
+		t->exposure.val = IMX586_EXPOSURE_DEFAULT + (i & 1);
+		if (imx586_set_exposure_cluster(imx586) || bus->num_transfers != 1)
+			break;
+	}
+	ns = ktime_get_ns() - start;
+
+	KUNIT_EXPECT_EQ(test, i, (unsigned int)IMX586_TEST_BENCH_LOOPS);
+	kunit_info(test, "exposure update: %llu ns, %u bytes on the bus\n",
+		   div_u64(ns, IMX586_TEST_BENCH_LOOPS), bus->log_len +
+		   2 * bus->num_writes);
+}
+
+static struct kunit_case imx586_test_cases[] = {
+	KUNIT_CASE(imx586_test_exposure_limits),
+	KUNIT_CASE(imx586_test_exposure_values),
+	KUNIT_CASE(imx586_test_dol_short_exposure),
+	KUNIT_CASE(imx586_test_write_regs),
+	KUNIT_CASE(imx586_test_nack_retry),
+	KUNIT_CASE(imx586_test_exposure_cluster),
+	{}
+};
+
+static struct kunit_suite imx586_test_suite = {
+	.name = "imx586",
+	.init = imx586_test_init,
+	.exit = imx586_test_exit,
+	.test_cases = imx586_test_cases,
+};
+kunit_test_suite(imx586_test_suite);
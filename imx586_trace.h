@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Tracepoints for the Sony imx586 V4L2 driver.
+ *
+ * Copyright (C) 2024 OCTOPUS CINEMA
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM imx586
+
+#if !defined(_IMX586_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _IMX586_TRACE_H_
+
+#include <linux/i2c.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(imx586_client_class,
+	TP_PROTO(const struct i2c_client *client),
+	TP_ARGS(client),
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+	),
+	TP_fast_assign(
+		__entry->adapter = client->adapter->nr;
+		__entry->addr = client->addr;
+	),
+	TP_printk("%d-%04x", __entry->adapter, __entry->addr)
+);
+
+TRACE_EVENT(imx586_set_exposure,
+	TP_PROTO(const struct i2c_client *client, u32 exposure, u32 shr,
+		 u32 vmax, u32 hmax),
+	TP_ARGS(client, exposure, shr, vmax, hmax),
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u32, exposure)
+		__field(u32, shr)
+		__field(u32, vmax)
+		__field(u32, hmax)
+	),
+	TP_fast_assign(
+		__entry->adapter = client->adapter->nr;
+		__entry->addr = client->addr;
+		__entry->exposure = exposure;
+		__entry->shr = shr;
+		__entry->vmax = vmax;
+		__entry->hmax = hmax;
+	),
+	TP_printk("%d-%04x exposure=%u SHR=%u VMAX=%u HMAX=%u",
+		  __entry->adapter, __entry->addr, __entry->exposure,
+		  __entry->shr, __entry->vmax, __entry->hmax)
+);
+
+TRACE_EVENT(imx586_set_gain,
+	TP_PROTO(const struct i2c_client *client, u32 gain, bool hcg),
+	TP_ARGS(client, gain, hcg),
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u32, gain)
+		__field(bool, hcg)
+	),
+	TP_fast_assign(
+		__entry->adapter = client->adapter->nr;
+		__entry->addr = client->addr;
+		__entry->gain = gain;
+		__entry->hcg = hcg;
+	),
+	TP_printk("%d-%04x gain=%u HCG=%d",
+		  __entry->adapter, __entry->addr, __entry->gain, __entry->hcg)
+);
+
+TRACE_EVENT(imx586_set_hblank,
+	TP_PROTO(const struct i2c_client *client, u32 hblank, u32 hmax),
+	TP_ARGS(client, hblank, hmax),
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u32, hblank)
+		__field(u32, hmax)
+	),
+	TP_fast_assign(
+		__entry->adapter = client->adapter->nr;
+		__entry->addr = client->addr;
+		__entry->hblank = hblank;
+		__entry->hmax = hmax;
+	),
+	TP_printk("%d-%04x hblank=%u HMAX=%u",
+		  __entry->adapter, __entry->addr, __entry->hblank,
+		  __entry->hmax)
+);
+
+/* One bus write: a register field, a burst run or a transaction message */
+TRACE_EVENT(imx586_i2c_write,
+	TP_PROTO(const struct i2c_client *client, u16 reg, unsigned int len,
+		 int ret),
+	TP_ARGS(client, reg, len, ret),
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u16, reg)
+		__field(unsigned int, len)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->adapter = client->adapter->nr;
+		__entry->addr = client->addr;
+		__entry->reg = reg;
+		__entry->len = len;
+		__entry->ret = ret;
+	),
+	TP_printk("%d-%04x reg=0x%04x len=%u ret=%d",
+		  __entry->adapter, __entry->addr, __entry->reg, __entry->len,
+		  __entry->ret)
+);
+
+TRACE_EVENT(imx586_stream_on,
+	TP_PROTO(const struct i2c_client *client, u32 width, u32 height,
+		 u32 vmax, u32 hmax),
+	TP_ARGS(client, width, height, vmax, hmax),
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u32, width)
+		__field(u32, height)
+		__field(u32, vmax)
+		__field(u32, hmax)
+	),
+	TP_fast_assign(
+		__entry->adapter = client->adapter->nr;
+		__entry->addr = client->addr;
+		__entry->width = width;
+		__entry->height = height;
+		__entry->vmax = vmax;
+		__entry->hmax = hmax;
+	),
+	TP_printk("%d-%04x %ux%u VMAX=%u HMAX=%u",
+		  __entry->adapter, __entry->addr, __entry->width,
+		  __entry->height, __entry->vmax, __entry->hmax)
+);
+
+DEFINE_EVENT(imx586_client_class, imx586_stream_off,
+	TP_PROTO(const struct i2c_client *client),
+	TP_ARGS(client)
+);
+
+#endif /* _IMX586_TRACE_H_ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE imx586_trace
+#include <trace/define_trace.h>
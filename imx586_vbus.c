@@ -0,0 +1,479 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Virtual I2C bus for running the Sony imx586 driver without a sensor.
+ *
+ * An "optimedio,imx586-vbus" platform node registers an I2C adapter that
+ * stands in for the sensor. Writes auto-increment into a 64 KiB register
+ * file, reads return it, and the chip ID register starts out at the
+ * power-on value the driver checks.
+ * The sensor node below it is probed by the real driver, with fixed clock
+ * and regulator nodes from imx586-vbus-overlay.dts.
+ *
+ * debugfs (imx586-vbus/):
+ *  log	  every message since the last reset, with a timestamp.
+ *	  Writing clears it.
+ *  run	  writing streams each mode the sensor enumerates on and off
+ *	  once. Reading reports the transfers, bytes, stream on time and
+ *	  modelled bus time at 100 kHz, 400 kHz and 1 MHz for each mode,
+ *	  and how often the chip ID was read since the bus was created.
+ *
+ * With emulate_clock set, each transfer also takes as long as it would
+ * at the bus clock from the node's clock-frequency.
+ *
+ * Copyright (C) 2024 OCTOPUS CINEMA
+ */
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/seq_file.h>
+#include <media/v4l2-subdev.h>
+
+#include <asm/unaligned.h>
+
+#include "imx586.h"
+
+static bool emulate_clock;
+module_param(emulate_clock, bool, 0644);
+MODULE_PARM_DESC(emulate_clock, "Delay each transfer by its time at the bus clock");
+
+#define IMX586_VBUS_NUM_REGS		0x10000
+#define IMX586_VBUS_REG_CHIP_ID		0x30DC
+#define IMX586_VBUS_CHIP_ID		0x32
+
+#define IMX586_VBUS_LOG_LEN		8192
+#define IMX586_VBUS_MAX_MODES		64
+
+/* The driver's image pad */
+#define IMX586_VBUS_IMAGE_PAD		0
+
+static const unsigned int imx586_vbus_xfers[] = {
+	V4L2_XFER_FUNC_DEFAULT, V4L2_XFER_FUNC_GRADATION_COMPRESSION,
+	V4L2_XFER_FUNC_DOL_HDR,
+};
+
+static const unsigned int imx586_vbus_model_hz[] = { 100000, 400000, 1000000 };
+
+struct imx586_vbus_msg {
+	u64 ns;
+	u16 addr;
+	u16 reg;
+	u16 len;
+	bool read;
+};
+
+/* Bus traffic since the counters were last cleared */
+struct imx586_vbus_count {
+	u64 xfers;
+	u64 msgs;
+	u64 bytes;
+};
+
+struct imx586_vbus_result {
+	u32 code;
+	u32 width;
+	u32 height;
+	u32 xfer_func;
+	int ret;
+	u64 stream_on_ns;
+	struct imx586_vbus_count count;
+};
+
+struct imx586_vbus {
+	struct device *dev;
+	struct i2c_adapter adap;
+	u32 hz;
+
+	/* Protects everything below, taken for each transfer */
+	struct mutex lock;
+	u8 *regs;
+	u16 ptr;
+	u64 chip_id_reads;
+	struct imx586_vbus_count count;
+	unsigned int log_head;
+	unsigned int log_num;
+	struct imx586_vbus_msg *log;
+
+	/* Serialises runs */
+	struct mutex run_lock;
+	unsigned int num_results;
+	struct imx586_vbus_result results[IMX586_VBUS_MAX_MODES];
+};
+
+/* Start, address and stop take 11 clocks, each byte 9 with its ACK */
+static u64 imx586_vbus_time_ns(u64 msgs, u64 bytes, u32 hz)
+{
+	return div_u64((msgs * (1 + 9 + 1) + bytes * 9) * NSEC_PER_SEC, hz);
+}
+
+static void imx586_vbus_log(struct imx586_vbus *vbus, u64 ns, u16 addr,
+			    u16 reg, u16 len, bool read)
+{
+	struct imx586_vbus_msg *m = &vbus->log[vbus->log_head];
+
+	m->ns = ns;
+	m->addr = addr;
+	m->reg = reg;
+	m->len = len;
+	m->read = read;
+	vbus->log_head = (vbus->log_head + 1) % IMX586_VBUS_LOG_LEN;
+	vbus->log_num = min(vbus->log_num + 1, IMX586_VBUS_LOG_LEN);
+}
+
+/*
+ * A write sets the register pointer from its first two bytes and stores
+ * the rest from there. A read returns registers from the pointer on.
+ */
+static int imx586_vbus_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			    int num)
+{
+	struct imx586_vbus *vbus = i2c_get_adapdata(adap);
+	u64 now = ktime_get_ns(), bytes = 0;
+	int i, j;
+
+	mutex_lock(&vbus->lock);
+
+	for (i = 0; i < num; i++) {
+		struct i2c_msg *msg = &msgs[i];
+		bool read = msg->flags & I2C_M_RD;
+
+		if (read) {
+			if (vbus->ptr == IMX586_VBUS_REG_CHIP_ID)
+				vbus->chip_id_reads++;
+			for (j = 0; j < msg->len; j++)
+				msg->buf[j] = vbus->regs[(u16)(vbus->ptr + j)];
+		} else if (msg->len >= 2) {
+			vbus->ptr = get_unaligned_be16(msg->buf);
+			for (j = 2; j < msg->len; j++)
+				vbus->regs[(u16)(vbus->ptr + j - 2)] = msg->buf[j];
+		}
+
+		imx586_vbus_log(vbus, now, msg->addr, vbus->ptr,
+				read ? msg->len : max_t(int, msg->len - 2, 0),
+				read);
+		bytes += msg->len;
+	}
+
+	vbus->count.xfers++;
+	vbus->count.msgs += num;
+	vbus->count.bytes += bytes;
+
+	mutex_unlock(&vbus->lock);
+
+	if (emulate_clock)
+		fsleep(div_u64(imx586_vbus_time_ns(num, bytes, vbus->hz),
+			       NSEC_PER_USEC));
+
+	return num;
+}
+
+static u32 imx586_vbus_functionality(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm imx586_vbus_algo = {
+	.master_xfer = imx586_vbus_xfer,
+	.functionality = imx586_vbus_functionality,
+};
+
+static void imx586_vbus_clear(struct imx586_vbus *vbus)
+{
+	mutex_lock(&vbus->lock);
+	memset(&vbus->count, 0, sizeof(vbus->count));
+	vbus->log_head = 0;
+	vbus->log_num = 0;
+	mutex_unlock(&vbus->lock);
+}
+
+static int imx586_vbus_find_sensor(struct device *dev, void *data)
+{
+	struct i2c_client *client = i2c_verify_client(dev);
+	struct v4l2_subdev **sd = data;
+
+	if (!client || !client->dev.driver ||
+	    !of_device_is_compatible(client->dev.of_node, "sony,imx586"))
+		return 0;
+
+	*sd = i2c_get_clientdata(client);
+
+	return 1;
+}
+
+static bool imx586_vbus_seen(struct imx586_vbus *vbus,
+			     const struct v4l2_mbus_framefmt *fmt)
+{
+	unsigned int i;
+
+	for (i = 0; i < vbus->num_results; i++)
+		if (vbus->results[i].code == fmt->code &&
+		    vbus->results[i].width == fmt->width &&
+		    vbus->results[i].height == fmt->height &&
+		    vbus->results[i].xfer_func == fmt->xfer_func)
+			return true;
+
+	return false;
+}
+
+/* Select one mode, then stream it on and off while counting the traffic */
+static void imx586_vbus_run_mode(struct imx586_vbus *vbus,
+				 struct v4l2_subdev *sd, u32 code, u32 width,
+				 u32 height, u32 xfer_func)
+{
+	struct v4l2_subdev_format fmt = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.pad = IMX586_VBUS_IMAGE_PAD,
+		.format = {
+			.code = code,
+			.width = width,
+			.height = height,
+			.xfer_func = xfer_func,
+		},
+	};
+	struct imx586_vbus_result *r;
+	u64 start;
+	int ret;
+
+	if (vbus->num_results == IMX586_VBUS_MAX_MODES)
+		return;
+
+	ret = v4l2_subdev_call(sd, pad, set_fmt, NULL, &fmt);
+	if (ret || imx586_vbus_seen(vbus, &fmt.format))
+		return;
+
+	r = &vbus->results[vbus->num_results++];
+	r->code = fmt.format.code;
+	r->width = fmt.format.width;
+	r->height = fmt.format.height;
+	r->xfer_func = fmt.format.xfer_func;
+
+	imx586_vbus_clear(vbus);
+	start = ktime_get_ns();
+	r->ret = v4l2_subdev_call(sd, video, s_stream, 1);
+	r->stream_on_ns = ktime_get_ns() - start;
+
+	mutex_lock(&vbus->lock);
+	r->count = vbus->count;
+	mutex_unlock(&vbus->lock);
+
+	if (!r->ret)
+		v4l2_subdev_call(sd, video, s_stream, 0);
+}
+
+static int imx586_vbus_run(struct imx586_vbus *vbus)
+{
+	struct v4l2_subdev_mbus_code_enum mc = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.pad = IMX586_VBUS_IMAGE_PAD,
+	};
+	struct v4l2_subdev *sd = NULL;
+	unsigned int x;
+
+	if (!device_for_each_child(&vbus->adap.dev, &sd,
+				   imx586_vbus_find_sensor))
+		return -ENODEV;
+
+	vbus->num_results = 0;
+
+	for (mc.index = 0; !v4l2_subdev_call(sd, pad, enum_mbus_code, NULL, &mc);
+	     mc.index++) {
+		struct v4l2_subdev_frame_size_enum fse = {
+			.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+			.pad = IMX586_VBUS_IMAGE_PAD,
+			.code = mc.code,
+		};
+
+		for (fse.index = 0;
+		     !v4l2_subdev_call(sd, pad, enum_frame_size, NULL, &fse);
+		     fse.index++)
+			for (x = 0; x < ARRAY_SIZE(imx586_vbus_xfers); x++)
+				imx586_vbus_run_mode(vbus, sd, mc.code,
+						     fse.max_width,
+						     fse.max_height,
+						     imx586_vbus_xfers[x]);
+	}
+
+	return 0;
+}
+
+static int imx586_vbus_run_show(struct seq_file *m, void *data)
+{
+	struct imx586_vbus *vbus = m->private;
+	unsigned int i, j;
+
+	mutex_lock(&vbus->run_lock);
+	mutex_lock(&vbus->lock);
+	seq_printf(m, "# chip ID reads %llu\n", vbus->chip_id_reads);
+	mutex_unlock(&vbus->lock);
+	seq_printf(m, "# code width height xfer ret xfers msgs bytes stream_on_us");
+	for (j = 0; j < ARRAY_SIZE(imx586_vbus_model_hz); j++)
+		seq_printf(m, " %ukHz_us", imx586_vbus_model_hz[j] / 1000);
+	seq_putc(m, '\n');
+
+	for (i = 0; i < vbus->num_results; i++) {
+		const struct imx586_vbus_result *r = &vbus->results[i];
+
+		seq_printf(m, "0x%04x %u %u %u %d %llu %llu %llu %llu", r->code,
+			   r->width, r->height, r->xfer_func, r->ret,
+			   r->count.xfers, r->count.msgs, r->count.bytes,
+			   div_u64(r->stream_on_ns, NSEC_PER_USEC));
+		for (j = 0; j < ARRAY_SIZE(imx586_vbus_model_hz); j++)
+			seq_printf(m, " %llu",
+				   div_u64(imx586_vbus_time_ns(r->count.msgs,
+							       r->count.bytes,
+							       imx586_vbus_model_hz[j]),
+					   NSEC_PER_USEC));
+		seq_putc(m, '\n');
+	}
+	mutex_unlock(&vbus->run_lock);
+
+	return 0;
+}
+
+static int imx586_vbus_run_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, imx586_vbus_run_show, inode->i_private);
+}
+
+static ssize_t imx586_vbus_run_write(struct file *file, const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct imx586_vbus *vbus = ((struct seq_file *)file->private_data)->private;
+	int ret;
+
+	mutex_lock(&vbus->run_lock);
+	ret = imx586_vbus_run(vbus);
+	mutex_unlock(&vbus->run_lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations imx586_vbus_run_fops = {
+	.owner = THIS_MODULE,
+	.open = imx586_vbus_run_open,
+	.read = seq_read,
+	.write = imx586_vbus_run_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int imx586_vbus_log_show(struct seq_file *m, void *data)
+{
+	struct imx586_vbus *vbus = m->private;
+	unsigned int i, first;
+
+	mutex_lock(&vbus->lock);
+	first = (vbus->log_head + IMX586_VBUS_LOG_LEN - vbus->log_num) %
+		IMX586_VBUS_LOG_LEN;
+	for (i = 0; i < vbus->log_num; i++) {
+		const struct imx586_vbus_msg *msg =
+			&vbus->log[(first + i) % IMX586_VBUS_LOG_LEN];
+
+		seq_printf(m, "%llu 0x%02x %c 0x%04x %u\n", msg->ns, msg->addr,
+			   msg->read ? 'R' : 'W', msg->reg, msg->len);
+	}
+	mutex_unlock(&vbus->lock);
+
+	return 0;
+}
+
+static int imx586_vbus_log_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, imx586_vbus_log_show, inode->i_private);
+}
+
+static ssize_t imx586_vbus_log_write(struct file *file, const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	imx586_vbus_clear(((struct seq_file *)file->private_data)->private);
+
+	return count;
+}
+
+static const struct file_operations imx586_vbus_log_fops = {
+	.owner = THIS_MODULE,
+	.open = imx586_vbus_log_open,
+	.read = seq_read,
+	.write = imx586_vbus_log_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void imx586_vbus_debugfs_remove(void *data)
+{
+	debugfs_remove_recursive(data);
+}
+
+static int imx586_vbus_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct imx586_vbus *vbus;
+	struct dentry *dir;
+	int ret;
+
+	vbus = devm_kzalloc(dev, sizeof(*vbus), GFP_KERNEL);
+	if (!vbus)
+		return -ENOMEM;
+
+	vbus->regs = devm_kzalloc(dev, IMX586_VBUS_NUM_REGS, GFP_KERNEL);
+	vbus->log = devm_kcalloc(dev, IMX586_VBUS_LOG_LEN, sizeof(*vbus->log),
+				 GFP_KERNEL);
+	if (!vbus->regs || !vbus->log)
+		return -ENOMEM;
+	/* Power-on value, the driver may overwrite it like on the sensor */
+	vbus->regs[IMX586_VBUS_REG_CHIP_ID] = IMX586_VBUS_CHIP_ID;
+
+	vbus->dev = dev;
+	vbus->hz = I2C_MAX_STANDARD_MODE_FREQ;
+	device_property_read_u32(dev, "clock-frequency", &vbus->hz);
+	mutex_init(&vbus->lock);
+	mutex_init(&vbus->run_lock);
+
+	dir = debugfs_create_dir("imx586-vbus", NULL);
+	ret = devm_add_action_or_reset(dev, imx586_vbus_debugfs_remove, dir);
+	if (ret)
+		return ret;
+	debugfs_create_file("log", 0600, dir, vbus, &imx586_vbus_log_fops);
+	debugfs_create_file("run", 0600, dir, vbus, &imx586_vbus_run_fops);
+
+	/* The sensor node below ours is instantiated by the I2C core */
+	vbus->adap.owner = THIS_MODULE;
+	vbus->adap.algo = &imx586_vbus_algo;
+	vbus->adap.dev.parent = dev;
+	vbus->adap.dev.of_node = dev->of_node;
+	strscpy(vbus->adap.name, "imx586-vbus", sizeof(vbus->adap.name));
+	i2c_set_adapdata(&vbus->adap, vbus);
+
+	ret = devm_i2c_add_adapter(dev, &vbus->adap);
+	if (ret)
+		return ret;
+
+	dev_info(dev, "virtual imx586 bus %d at %u Hz\n", vbus->adap.nr,
+		 vbus->hz);
+
+	return 0;
+}
+
+static const struct of_device_id imx586_vbus_dt_ids[] = {
+	{ .compatible = "optimedio,imx586-vbus" },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(of, imx586_vbus_dt_ids);
+
+static struct platform_driver imx586_vbus_driver = {
+	.driver = {
+		.name = "imx586-vbus",
+		.of_match_table = imx586_vbus_dt_ids,
+	},
+	.probe = imx586_vbus_probe,
+};
+module_platform_driver(imx586_vbus_driver);
+
+MODULE_AUTHOR("Marcin Paszkuta <marcin.paszkuta@optimedio.com>");
+MODULE_DESCRIPTION("Virtual I2C bus emulating a Sony imx586 for testing");
+MODULE_LICENSE("GPL v2");
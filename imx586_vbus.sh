@@ -0,0 +1,46 @@
+#!/usr/bin/bash
+# Run every imx586 mode on the virtual I2C bus and print the bus cost of
+# each. Needs root, debugfs and either dtoverlay or the device tree
+# overlay configfs. Exits nonzero if any mode failed to stream.
+set -e
+
+cd "$(dirname "$0")"
+DBG=/sys/kernel/debug/imx586-vbus
+CFS=/sys/kernel/config/device-tree/overlays/imx586-vbus
+
+make imx586-vbus-overlay.dtbo
+make vbus
+
+# Unload the modules and drop the overlay again, also after a failure or
+# a previous run that did not get that far
+cleanup() {
+	rmmod imx586_vbus 2>/dev/null || true
+	rmmod imx586 2>/dev/null || true
+	if [ -d ${CFS} ]; then
+		rmdir ${CFS}
+	elif [ ! -d "$(dirname ${CFS})" ]; then
+		dtoverlay -r imx586-vbus-overlay 2>/dev/null || true
+	fi
+}
+cleanup
+trap cleanup EXIT
+
+if [ -d "$(dirname ${CFS})" ]; then
+	mkdir -p ${CFS}
+	cat imx586-vbus-overlay.dtbo > ${CFS}/dtbo
+else
+	dtoverlay -d . imx586-vbus-overlay "$@"
+fi
+
+insmod imx586.ko
+insmod imx586_vbus.ko
+
+for i in $(seq 50); do
+	[ -e ${DBG}/run ] && echo 1 > ${DBG}/run 2>/dev/null && break
+	sleep 0.1
+done
+
+cat ${DBG}/run
+
+grep -q '^0x' ${DBG}/run
+awk '!/^#/ && $5 != 0 { exit 1 }' ${DBG}/run